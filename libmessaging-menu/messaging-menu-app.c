@@ -22,7 +22,6 @@
 #include "indicator-messages-application.h"
 
 #include <gio/gdesktopappinfo.h>
-#include <string.h>
 
 /**
  * SECTION:messaging-menu-app
@@ -106,13 +105,31 @@ struct _MessagingMenuApp
   gboolean status_set;
   GDBusConnection *bus;
 
+  /* messages sorted newest first, as they are listed to the service,
+   * and indexed by id (pointing to their iters in that sequence) */
+  GSequence *message_order;
   GHashTable *messages;
-  GList *sources;
+
+  /* monotonic times at which messages expire, by id */
+  GHashTable *message_expiries;
+  /* sources in the order in which they are shown, and indexed by id
+   * (pointing to their iters in that sequence) */
+  GSequence *sources;
+  GHashTable *source_index;
   IndicatorMessagesApplication *app_interface;
 
   IndicatorMessagesService *messages_service;
   guint watch_id;
 
+  /* Services which support RegisterApplicationWithState also take
+   * changes in batches, which are collected here and sent from idle */
+  gboolean batch_changes;
+  GVariantBuilder *changes;
+  guint changes_idle;
+
+  /* hashes of the icons that were sent to the service with IconAdded */
+  GHashTable *sent_icons;
+
   GCancellable *cancellable;
 };
 
@@ -145,14 +162,26 @@ typedef struct
   gint64 time;
   gchar *string;
   gboolean draws_attention;
+
+  gint64 expires;  /* monotonic time, or 0 */
 } Source;
 
 static void global_status_changed (IndicatorMessagesService *service,
                                    const gchar *status_str,
                                    gpointer user_data);
 
+static void messaging_menu_app_notify_all_time_to_live (MessagingMenuApp *app);
+
 /* in messaging-menu-message.c */
-GVariant * _messaging_menu_message_to_variant (MessagingMenuMessage *msg);
+GVariant * _messaging_menu_message_to_variant (MessagingMenuMessage *msg,
+                                               GVariant             *serialized_icon);
+
+/* icons which serialize to less than this are always sent inline */
+#define ICON_REF_MIN_SIZE 256
+
+/* the number of messages sent along with the registration; the service
+ * lists the rest with ListMessagesPage */
+#define REGISTER_MESSAGES_MAX 50
 
 static void
 source_free (gpointer data)
@@ -170,19 +199,15 @@ source_free (gpointer data)
 }
 
 static GVariant *
-source_to_variant (Source *source)
+source_to_variant (Source   *source,
+                   GVariant *serialized_icon)
 {
   GVariant *v;
-  GVariant *serialized_icon;
   GVariantBuilder builder;
 
-  serialized_icon = source->icon ? g_icon_serialize (source->icon) : NULL;
   g_variant_builder_init (&builder, G_VARIANT_TYPE ("av"));
   if (serialized_icon)
-    {
-      g_variant_builder_add (&builder, "v", serialized_icon);
-      g_variant_unref (serialized_icon);
-    }
+    g_variant_builder_add (&builder, "v", serialized_icon);
 
   v = g_variant_new ("(ssavuxsb)", source->id,
                                    source->label,
@@ -212,6 +237,129 @@ messaging_menu_app_get_dbus_object_path (MessagingMenuApp *app)
   return path;
 }
 
+static void
+messaging_menu_app_discard_changes (MessagingMenuApp *app)
+{
+  if (app->changes_idle)
+    {
+      g_source_remove (app->changes_idle);
+      app->changes_idle = 0;
+    }
+
+  g_clear_pointer (&app->changes, g_variant_builder_unref);
+}
+
+static void
+messaging_menu_app_flush_changes (MessagingMenuApp *app)
+{
+  if (app->changes)
+    indicator_messages_application_emit_changes (app->app_interface,
+                                                 g_variant_builder_end (app->changes));
+
+  messaging_menu_app_discard_changes (app);
+}
+
+static gboolean
+messaging_menu_app_changes_idle (gpointer user_data)
+{
+  MessagingMenuApp *app = user_data;
+
+  app->changes_idle = 0;
+  messaging_menu_app_flush_changes (app);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Emits the change signal @signal_name with @parameters (which may be
+ * floating).  If the service takes batches, the change is sent along
+ * with all other changes of this main loop iteration instead. */
+static void
+messaging_menu_app_emit_change (MessagingMenuApp *app,
+                                const gchar      *signal_name,
+                                GVariant         *parameters)
+{
+  GDBusInterfaceSkeleton *skeleton = G_DBUS_INTERFACE_SKELETON (app->app_interface);
+  GDBusConnection *connection;
+
+  if (app->batch_changes)
+    {
+      if (app->changes == NULL)
+        app->changes = g_variant_builder_new (G_VARIANT_TYPE ("a(sv)"));
+
+      g_variant_builder_add (app->changes, "(sv)", signal_name, parameters);
+
+      if (app->changes_idle == 0)
+        app->changes_idle = g_idle_add (messaging_menu_app_changes_idle, app);
+
+      return;
+    }
+
+  connection = g_dbus_interface_skeleton_get_connection (skeleton);
+  if (connection)
+    g_dbus_connection_emit_signal (connection, NULL,
+                                   g_dbus_interface_skeleton_get_object_path (skeleton),
+                                   "org.ayatana.indicator.messages.application",
+                                   signal_name, parameters, NULL);
+  else
+    g_variant_unref (g_variant_ref_sink (parameters));
+}
+
+/* Must compute the same hash as im_icon_store_compute_hash() in the
+ * service: SHA-256 of the icon wrapped in a variant, in normal form */
+static gchar *
+icon_compute_hash (GVariant *serialized_icon)
+{
+  GVariant *boxed;
+  GVariant *normal;
+  gchar *hash;
+
+  boxed = g_variant_ref_sink (g_variant_new_variant (serialized_icon));
+  normal = g_variant_get_normal_form (boxed);
+
+  hash = g_compute_checksum_for_data (G_CHECKSUM_SHA256,
+                                      g_variant_get_data (normal),
+                                      g_variant_get_size (normal));
+
+  g_variant_unref (normal);
+  g_variant_unref (boxed);
+
+  return hash;
+}
+
+/* Serializes @icon for a SourceAdded, SourceChanged or MessageAdded
+ * change.  Services which batch changes keep the icons they are sent
+ * with IconAdded, so large icons (avatars, mostly) are sent only once
+ * and referred to by the hash of their contents afterwards.
+ *
+ * Returns: a new reference, or %NULL if @icon is %NULL */
+static GVariant *
+messaging_menu_app_serialize_icon (MessagingMenuApp *app,
+                                   GIcon            *icon)
+{
+  GVariant *serialized_icon;
+  gchar *hash;
+
+  serialized_icon = icon ? g_icon_serialize (icon) : NULL;
+  if (serialized_icon == NULL || !app->batch_changes ||
+      g_variant_get_size (serialized_icon) < ICON_REF_MIN_SIZE)
+    return serialized_icon;
+
+  hash = icon_compute_hash (serialized_icon);
+
+  if (!g_hash_table_contains (app->sent_icons, hash))
+    {
+      messaging_menu_app_emit_change (app, "IconAdded",
+                                      g_variant_new ("(sv)", hash, serialized_icon));
+      g_hash_table_add (app->sent_icons, g_strdup (hash));
+    }
+
+  g_variant_unref (serialized_icon);
+  serialized_icon = g_variant_ref_sink (g_variant_new ("(sv)", "icon-ref", g_variant_new_string (hash)));
+
+  g_free (hash);
+  return serialized_icon;
+}
+
 static void
 messaging_menu_app_got_bus (GObject      *source,
                             GAsyncResult *res,
@@ -298,6 +446,8 @@ messaging_menu_app_dispose (GObject *object)
       app->watch_id = 0;
     }
 
+  messaging_menu_app_discard_changes (app);
+
   if (app->cancellable)
     {
       g_cancellable_cancel (app->cancellable);
@@ -318,9 +468,12 @@ messaging_menu_app_dispose (GObject *object)
     }
 
   g_clear_pointer (&app->messages, g_hash_table_unref);
+  g_clear_pointer (&app->message_order, g_sequence_free);
+  g_clear_pointer (&app->message_expiries, g_hash_table_unref);
+  g_clear_pointer (&app->sent_icons, g_hash_table_unref);
 
-  g_list_free_full (app->sources, source_free);
-  app->sources = NULL;
+  g_clear_pointer (&app->source_index, g_hash_table_unref);
+  g_clear_pointer (&app->sources, g_sequence_free);
 
   g_clear_object (&app->app_interface);
   g_clear_object (&app->appinfo);
@@ -453,50 +606,175 @@ indicator_messages_vanished (GDBusConnection *bus,
                                             app);
       g_clear_object (&app->messages_service);
     }
+
+  /* the next service gets the whole state when registering */
+  app->batch_changes = FALSE;
+  messaging_menu_app_discard_changes (app);
+  g_hash_table_remove_all (app->sent_icons);
 }
 
-static gboolean
-messaging_menu_app_list_sources (IndicatorMessagesApplication *app_interface,
-                                 GDBusMethodInvocation        *invocation,
-                                 gpointer                      user_data)
+static GVariant *
+messaging_menu_app_sources_to_variant (MessagingMenuApp *app)
 {
-  MessagingMenuApp *app = user_data;
   GVariantBuilder builder;
-  GList *it;
+  GSequenceIter *it;
 
   g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ssavuxsb)"));
 
-  for (it = app->sources; it; it = it->next)
-    g_variant_builder_add_value (&builder, source_to_variant (it->data));
+  for (it = g_sequence_get_begin_iter (app->sources); !g_sequence_iter_is_end (it); it = g_sequence_iter_next (it))
+    {
+      Source *source = g_sequence_get (it);
+      GVariant *serialized_icon;
 
-  indicator_messages_application_complete_list_sources (app_interface,
-                                                        invocation,
-                                                        g_variant_builder_end (&builder));
+      serialized_icon = source->icon ? g_icon_serialize (source->icon) : NULL;
+      g_variant_builder_add_value (&builder, source_to_variant (source, serialized_icon));
+      if (serialized_icon)
+        g_variant_unref (serialized_icon);
+    }
 
-  return TRUE;
+  return g_variant_builder_end (&builder);
 }
 
+/* Newest first, and by id for messages with the same time */
 static gint
-compare_source_id (gconstpointer a,
-                   gconstpointer b)
+compare_messages (gconstpointer a,
+                  gconstpointer b,
+                  gpointer      user_data)
 {
-  const Source *source = a;
-  const gchar *id = b;
+  MessagingMenuMessage *msg_a = (MessagingMenuMessage *) a;
+  MessagingMenuMessage *msg_b = (MessagingMenuMessage *) b;
+  gint64 time_a = messaging_menu_message_get_time (msg_a);
+  gint64 time_b = messaging_menu_message_get_time (msg_b);
+
+  if (time_a != time_b)
+    return time_a > time_b ? -1 : 1;
+
+  return g_strcmp0 (messaging_menu_message_get_id (msg_a),
+                    messaging_menu_message_get_id (msg_b));
+}
+
+/* Returns the iter of the first message that comes after @cursor, which
+ * is "<time>:<id>" of the last message a previous page ended with.  That
+ * message doesn't need to exist anymore. */
+static GSequenceIter *
+messaging_menu_app_find_cursor (MessagingMenuApp *app,
+                                const gchar      *cursor)
+{
+  MessagingMenuMessage *key;
+  GSequenceIter *iter;
+  gint64 time;
+  gchar *end;
+
+  if (cursor == NULL || cursor[0] == '\0')
+    return g_sequence_get_begin_iter (app->message_order);
+
+  time = g_ascii_strtoll (cursor, &end, 10);
+  if (*end != ':' || time < 0)
+    return g_sequence_get_begin_iter (app->message_order);
+
+  /* g_sequence_search() compares elements to a value of the same type */
+  key = messaging_menu_message_new (end + 1, NULL, "", NULL, NULL, time);
+  iter = g_sequence_search (app->message_order, key, compare_messages, NULL);
+  g_object_unref (key);
 
-  return strcmp (source->id, id);
+  return iter;
+}
+
+/* Serializes at most @max_messages messages starting at @iter, or all if
+ * @max_messages is 0.  @next_cursor is set to the cursor to continue
+ * with, or to "" if there are no more messages, and @attention_after to
+ * whether any of the messages after it draws attention. */
+static GVariant *
+messaging_menu_app_messages_to_variant (GSequenceIter  *iter,
+                                        guint           max_messages,
+                                        gchar         **next_cursor,
+                                        gboolean       *attention_after)
+{
+  GVariantBuilder builder;
+  MessagingMenuMessage *last = NULL;
+  guint n = 0;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(savsssxaa{sv}b)"));
+
+  for (; !g_sequence_iter_is_end (iter); iter = g_sequence_iter_next (iter))
+    {
+      MessagingMenuMessage *message = g_sequence_get (iter);
+      GIcon *icon = messaging_menu_message_get_icon (message);
+      GVariant *serialized_icon;
+
+      if (max_messages > 0 && n == max_messages)
+        break;
+
+      serialized_icon = icon ? g_icon_serialize (icon) : NULL;
+      g_variant_builder_add_value (&builder, _messaging_menu_message_to_variant (message, serialized_icon));
+      if (serialized_icon)
+        g_variant_unref (serialized_icon);
+
+      last = message;
+      n++;
+    }
+
+  if (next_cursor)
+    {
+      if (!g_sequence_iter_is_end (iter) && last)
+        *next_cursor = g_strdup_printf ("%" G_GINT64_FORMAT ":%s",
+                                        messaging_menu_message_get_time (last),
+                                        messaging_menu_message_get_id (last));
+      else
+        *next_cursor = g_strdup ("");
+    }
+
+  if (attention_after)
+    {
+      *attention_after = FALSE;
+      for (; !g_sequence_iter_is_end (iter); iter = g_sequence_iter_next (iter))
+        if (messaging_menu_message_get_draws_attention (g_sequence_get (iter)))
+          {
+            *attention_after = TRUE;
+            break;
+          }
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+static MessagingMenuMessage *
+messaging_menu_app_lookup_message (MessagingMenuApp *app,
+                                   const gchar      *id)
+{
+  GSequenceIter *iter;
+
+  iter = g_hash_table_lookup (app->messages, id);
+
+  return iter ? g_sequence_get (iter) : NULL;
+}
+
+static gboolean
+messaging_menu_app_list_sources (IndicatorMessagesApplication *app_interface,
+                                 GDBusMethodInvocation        *invocation,
+                                 gpointer                      user_data)
+{
+  MessagingMenuApp *app = user_data;
+
+  indicator_messages_application_complete_list_sources (app_interface,
+                                                        invocation,
+                                                        messaging_menu_app_sources_to_variant (app));
+
+  return TRUE;
 }
 
 static gboolean
 messaging_menu_app_remove_source_internal (MessagingMenuApp *app,
                                            const gchar      *source_id)
 {
-  GList *node;
+  GSequenceIter *iter;
 
-  node = g_list_find_custom (app->sources, source_id, compare_source_id);
-  if (node)
+  iter = g_hash_table_lookup (app->source_index, source_id);
+  if (iter)
     {
-      source_free (node->data);
-      app->sources = g_list_delete_link (app->sources, node);
+      /* the index is keyed by the source's own id */
+      g_hash_table_remove (app->source_index, source_id);
+      g_sequence_remove (iter);
       return TRUE;
     }
 
@@ -507,7 +785,18 @@ static gboolean
 messaging_menu_app_remove_message_internal (MessagingMenuApp *app,
                                             const gchar      *message_id)
 {
-  return g_hash_table_remove (app->messages, message_id);
+  GSequenceIter *iter;
+
+  iter = g_hash_table_lookup (app->messages, message_id);
+  if (iter)
+    {
+      g_hash_table_remove (app->message_expiries, message_id);
+      g_hash_table_remove (app->messages, message_id);
+      g_sequence_remove (iter);
+      return TRUE;
+    }
+
+  return FALSE;
 }
 
 static gboolean
@@ -534,23 +823,36 @@ messaging_menu_app_list_messages (IndicatorMessagesApplication *app_interface,
                                   gpointer                      user_data)
 {
   MessagingMenuApp *app = user_data;
-  GVariantBuilder builder;
-  GHashTableIter iter;
-  MessagingMenuMessage *message;
-
-  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(savsssxaa{sv}b)"));
-
-  g_hash_table_iter_init (&iter, app->messages);
-  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &message))
-    g_variant_builder_add_value (&builder, _messaging_menu_message_to_variant (message));
 
   indicator_messages_application_complete_list_messages (app_interface,
                                                          invocation,
-                                                         g_variant_builder_end (&builder));
+                                                         messaging_menu_app_messages_to_variant (g_sequence_get_begin_iter (app->message_order),
+                                                                                                 0, NULL, NULL));
 
   return TRUE;
 }
 
+static gboolean
+messaging_menu_app_list_messages_page (IndicatorMessagesApplication *app_interface,
+                                       GDBusMethodInvocation        *invocation,
+                                       const gchar                  *cursor,
+                                       guint                         max_messages,
+                                       gpointer                      user_data)
+{
+  MessagingMenuApp *app = user_data;
+  GVariant *messages;
+  gchar *next_cursor;
+  gboolean attention_after;
+
+  messages = messaging_menu_app_messages_to_variant (messaging_menu_app_find_cursor (app, cursor),
+                                                     MAX (max_messages, 1), &next_cursor, &attention_after);
+  indicator_messages_application_complete_list_messages_page (app_interface, invocation,
+                                                              messages, next_cursor, attention_after);
+
+  g_free (next_cursor);
+  return TRUE;
+}
+
 static gboolean
 messaging_menu_app_activate_message (IndicatorMessagesApplication *app_interface,
                                      GDBusMethodInvocation        *invocation,
@@ -562,7 +864,7 @@ messaging_menu_app_activate_message (IndicatorMessagesApplication *app_interface
   MessagingMenuApp *app = user_data;
   MessagingMenuMessage *msg;
 
-  msg = g_hash_table_lookup (app->messages, message_id);
+  msg = messaging_menu_app_lookup_message (app, message_id);
   if (msg)
     {
       if (*action_id)
@@ -617,6 +919,27 @@ messaging_menu_app_dismiss (IndicatorMessagesApplication *app_interface,
   return TRUE;
 }
 
+static gboolean
+messaging_menu_app_release_icons (IndicatorMessagesApplication *app_interface,
+                                  GDBusMethodInvocation        *invocation,
+                                  const gchar * const          *hashes,
+                                  gpointer                      user_data)
+{
+  MessagingMenuApp *app = user_data;
+  const gchar * const *it;
+
+  /* The service keeps icons which pending changes refer to again, as
+   * long as those changes arrive before the reply */
+  messaging_menu_app_flush_changes (app);
+
+  for (it = hashes; *it; it++)
+    g_hash_table_remove (app->sent_icons, *it);
+
+  indicator_messages_application_complete_release_icons (app_interface, invocation);
+
+  return TRUE;
+}
+
 static void
 messaging_menu_app_init (MessagingMenuApp *app)
 {
@@ -633,12 +956,21 @@ messaging_menu_app_init (MessagingMenuApp *app)
                     G_CALLBACK (messaging_menu_app_activate_source), app);
   g_signal_connect (app->app_interface, "handle-list-messages",
                     G_CALLBACK (messaging_menu_app_list_messages), app);
+  g_signal_connect (app->app_interface, "handle-list-messages-page",
+                    G_CALLBACK (messaging_menu_app_list_messages_page), app);
   g_signal_connect (app->app_interface, "handle-activate-message",
                     G_CALLBACK (messaging_menu_app_activate_message), app);
   g_signal_connect (app->app_interface, "handle-dismiss",
                     G_CALLBACK (messaging_menu_app_dismiss), app);
+  g_signal_connect (app->app_interface, "handle-release-icons",
+                    G_CALLBACK (messaging_menu_app_release_icons), app);
 
-  app->messages = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+  app->message_order = g_sequence_new (g_object_unref);
+  app->messages = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  app->message_expiries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  app->sent_icons = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  app->sources = g_sequence_new (source_free);
+  app->source_index = g_hash_table_new (g_str_hash, g_str_equal);
 
   app->watch_id = g_bus_watch_name (G_BUS_TYPE_SESSION,
                                     "org.ayatana.indicator.messages",
@@ -669,6 +1001,43 @@ messaging_menu_app_new (const gchar *desktop_id)
                        NULL);
 }
 
+static void
+messaging_menu_app_registered_with_state (GObject      *source_object,
+                                          GAsyncResult *result,
+                                          gpointer      user_data)
+{
+  MessagingMenuApp *app = user_data;
+  GError *error = NULL;
+
+  if (indicator_messages_service_call_register_application_with_state_finish (INDICATOR_MESSAGES_SERVICE (source_object),
+                                                                              result, &error))
+    {
+      app->batch_changes = TRUE;
+      messaging_menu_app_notify_all_time_to_live (app);
+      return;
+    }
+
+  /* older services ask for sources and messages after registration */
+  if (g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD) &&
+      app->registered == TRUE && app->messages_service)
+    {
+      gchar *object_path;
+
+      object_path = messaging_menu_app_get_dbus_object_path (app);
+      if (object_path)
+        {
+          indicator_messages_service_call_register_application (app->messages_service,
+                                                                g_app_info_get_id (G_APP_INFO (app->appinfo)),
+                                                                object_path,
+                                                                app->cancellable,
+                                                                NULL, NULL);
+          g_free (object_path);
+        }
+    }
+
+  g_error_free (error);
+}
+
 /**
  * messaging_menu_app_register:
  * @app: a #MessagingMenuApp
@@ -688,6 +1057,9 @@ void
 messaging_menu_app_register (MessagingMenuApp *app)
 {
   gchar *object_path;
+  GVariant *messages;
+  gchar *messages_cursor;
+  gboolean messages_attention_after;
 
   g_return_if_fail (MESSAGING_MENU_IS_APP (app));
 
@@ -701,12 +1073,31 @@ messaging_menu_app_register (MessagingMenuApp *app)
   if (!object_path)
     return;
 
-  indicator_messages_service_call_register_application (app->messages_service,
-                                                        g_app_info_get_id (G_APP_INFO (app->appinfo)),
-                                                        object_path,
-                                                        app->cancellable,
-                                                        NULL, NULL);
+  /* Send the current state along, which saves the service from asking
+   * for it.  Changes after this point are signalled as usual.  Pending
+   * ones are part of the state, but must not arrive before it. */
+  messaging_menu_app_flush_changes (app);
+
+  /* the service forgets uploaded icons when an application registers */
+  g_hash_table_remove_all (app->sent_icons);
 
+  /* only the newest messages; the service pages through the rest */
+  messages = messaging_menu_app_messages_to_variant (g_sequence_get_begin_iter (app->message_order),
+                                                     REGISTER_MESSAGES_MAX, &messages_cursor,
+                                                     &messages_attention_after);
+
+  indicator_messages_service_call_register_application_with_state (app->messages_service,
+                                                                   g_app_info_get_id (G_APP_INFO (app->appinfo)),
+                                                                   object_path,
+                                                                   messaging_menu_app_sources_to_variant (app),
+                                                                   messages,
+                                                                   messages_cursor,
+                                                                   messages_attention_after,
+                                                                   app->cancellable,
+                                                                   messaging_menu_app_registered_with_state,
+                                                                   app);
+
+  g_free (messages_cursor);
   g_free (object_path);
 }
 
@@ -815,11 +1206,11 @@ static Source *
 messaging_menu_app_lookup_source (MessagingMenuApp *app,
                                   const gchar      *id)
 {
-  GList *node;
+  GSequenceIter *iter;
 
-  node = g_list_find_custom (app->sources, id, compare_source_id);
+  iter = g_hash_table_lookup (app->source_index, id);
 
-  return node ? node->data : NULL;
+  return iter ? g_sequence_get (iter) : NULL;
 }
 
 static Source *
@@ -839,8 +1230,97 @@ static void
 messaging_menu_app_notify_source_changed (MessagingMenuApp *app,
                                           Source           *source)
 {
-  indicator_messages_application_emit_source_changed (app->app_interface,
-                                                      source_to_variant (source));
+  GVariant *serialized_icon;
+
+  serialized_icon = messaging_menu_app_serialize_icon (app, source->icon);
+  messaging_menu_app_emit_change (app, "SourceChanged",
+                                  g_variant_new ("(@(ssavuxsb))", source_to_variant (source, serialized_icon)));
+  if (serialized_icon)
+    g_variant_unref (serialized_icon);
+}
+
+/* The service only shows sources that have a count, time or string */
+static gboolean
+source_is_visible (Source *source)
+{
+  return source->count > 0 || source->time != 0 || (source->string != NULL && source->string[0] != '\0');
+}
+
+/* Sends only the field @key of @source, which has just been set to
+ * @value.  Falls back to a full SourceChanged for services which don't
+ * batch changes, and when the source appears or disappears, because the
+ * service needs the label and icon for that.  Consumes @value if it is
+ * floating. */
+static void
+messaging_menu_app_notify_source_field (MessagingMenuApp *app,
+                                        Source           *source,
+                                        gboolean          was_visible,
+                                        const gchar      *key,
+                                        GVariant         *value)
+{
+  g_variant_ref_sink (value);
+
+  if (app->batch_changes && was_visible == source_is_visible (source))
+    {
+      GVariantBuilder builder;
+
+      g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+      g_variant_builder_add (&builder, "{sv}", key, value);
+      messaging_menu_app_emit_change (app, "SourceUpdated",
+                                      g_variant_new ("(sa{sv})", source->id, &builder));
+    }
+  else
+    {
+      messaging_menu_app_notify_source_changed (app, source);
+    }
+
+  g_variant_unref (value);
+}
+
+/* Tells the service to remove a source or message after the time left
+ * until @expires.  Only services which batch changes expire them. */
+static void
+messaging_menu_app_notify_time_to_live (MessagingMenuApp *app,
+                                        const gchar      *kind,
+                                        const gchar      *id,
+                                        gint64            expires)
+{
+  guint seconds = 0;
+
+  if (!app->batch_changes)
+    return;
+
+  if (expires)
+    {
+      gint64 remaining = expires - g_get_monotonic_time ();
+      seconds = MAX ((remaining + G_USEC_PER_SEC - 1) / G_USEC_PER_SEC, 1);
+    }
+
+  messaging_menu_app_emit_change (app, "TimeToLiveSet",
+                                  g_variant_new ("(ssu)", kind, id, seconds));
+}
+
+/* Sends the expiry times of all sources and messages, after they were
+ * registered with a service */
+static void
+messaging_menu_app_notify_all_time_to_live (MessagingMenuApp *app)
+{
+  GSequenceIter *it;
+  GHashTableIter iter;
+  gpointer id;
+  gpointer expires;
+
+  for (it = g_sequence_get_begin_iter (app->sources); !g_sequence_iter_is_end (it); it = g_sequence_iter_next (it))
+    {
+      Source *source = g_sequence_get (it);
+
+      if (source->expires)
+        messaging_menu_app_notify_time_to_live (app, "source", source->id, source->expires);
+    }
+
+  g_hash_table_iter_init (&iter, app->message_expiries);
+  while (g_hash_table_iter_next (&iter, &id, &expires))
+    messaging_menu_app_notify_time_to_live (app, "message", id, *(gint64 *) expires);
 }
 
 static void
@@ -854,6 +1334,7 @@ messaging_menu_app_insert_source_internal (MessagingMenuApp *app,
                                            const gchar      *string)
 {
   Source *source;
+  GVariant *serialized_icon;
 
   g_return_if_fail (MESSAGING_MENU_IS_APP (app));
   g_return_if_fail (id != NULL);
@@ -873,11 +1354,17 @@ messaging_menu_app_insert_source_internal (MessagingMenuApp *app,
   source->count = count;
   source->time = time;
   source->string = g_strdup (string);
-  app->sources = g_list_insert (app->sources, source, position);
 
-  indicator_messages_application_emit_source_added (app->app_interface,
-                                                    position,
-                                                    source_to_variant (source));
+  /* like g_list_insert(), appends for negative or too large positions */
+  g_hash_table_insert (app->source_index, source->id,
+                       g_sequence_insert_before (g_sequence_get_iter_at_pos (app->sources, position),
+                                                 source));
+
+  serialized_icon = messaging_menu_app_serialize_icon (app, source->icon);
+  messaging_menu_app_emit_change (app, "SourceAdded",
+                                  g_variant_new ("(u@(ssavuxsb))", position, source_to_variant (source, serialized_icon)));
+  if (serialized_icon)
+    g_variant_unref (serialized_icon);
 }
 
 /**
@@ -1108,7 +1595,7 @@ messaging_menu_app_remove_source (MessagingMenuApp *app,
   g_return_if_fail (source_id != NULL);
 
   if (messaging_menu_app_remove_source_internal (app, source_id))
-    indicator_messages_application_emit_source_removed (app->app_interface, source_id);
+    messaging_menu_app_emit_change (app, "SourceRemoved", g_variant_new ("(s)", source_id));
 }
 
 /**
@@ -1204,8 +1691,11 @@ void messaging_menu_app_set_source_count (MessagingMenuApp *app,
   source = messaging_menu_app_get_source (app, source_id);
   if (source)
     {
+      gboolean was_visible = source_is_visible (source);
+
       source->count = count;
-      messaging_menu_app_notify_source_changed (app, source);
+      messaging_menu_app_notify_source_field (app, source, was_visible,
+                                              "count", g_variant_new_uint32 (count));
     }
 }
 
@@ -1230,8 +1720,11 @@ messaging_menu_app_set_source_time (MessagingMenuApp *app,
   source = messaging_menu_app_get_source (app, source_id);
   if (source)
     {
+      gboolean was_visible = source_is_visible (source);
+
       source->time = time;
-      messaging_menu_app_notify_source_changed (app, source);
+      messaging_menu_app_notify_source_field (app, source, was_visible,
+                                              "time", g_variant_new_int64 (time));
     }
 }
 
@@ -1256,9 +1749,12 @@ messaging_menu_app_set_source_string (MessagingMenuApp *app,
   source = messaging_menu_app_get_source (app, source_id);
   if (source)
     {
+      gboolean was_visible = source_is_visible (source);
+
       g_free (source->string);
       source->string = g_strdup (str);
-      messaging_menu_app_notify_source_changed (app, source);
+      messaging_menu_app_notify_source_field (app, source, was_visible,
+                                              "string", g_variant_new_string (str ? str : ""));
     }
 }
 
@@ -1286,7 +1782,8 @@ messaging_menu_app_draw_attention (MessagingMenuApp *app,
   if (source)
     {
       source->draws_attention = TRUE;
-      messaging_menu_app_notify_source_changed (app, source);
+      messaging_menu_app_notify_source_field (app, source, source_is_visible (source),
+                                              "draws-attention", g_variant_new_boolean (TRUE));
     }
 }
 
@@ -1317,7 +1814,37 @@ messaging_menu_app_remove_attention (MessagingMenuApp *app,
   if (source)
     {
       source->draws_attention = FALSE;
-      messaging_menu_app_notify_source_changed (app, source);
+      messaging_menu_app_notify_source_field (app, source, source_is_visible (source),
+                                              "draws-attention", g_variant_new_boolean (FALSE));
+    }
+}
+
+/**
+ * messaging_menu_app_set_source_time_to_live:
+ * @app: a #MessagingMenuApp
+ * @source_id: a source id
+ * @seconds: the number of seconds after which the source is removed, or
+ *   0 to keep it until it is removed explicitly
+ *
+ * Makes the messaging menu remove @source_id after @seconds, as if the
+ * user had dismissed it, in case the application doesn't get around to
+ * removing it.  Messaging menus which don't support this ignore it.
+ */
+void
+messaging_menu_app_set_source_time_to_live (MessagingMenuApp *app,
+                                            const gchar      *source_id,
+                                            guint             seconds)
+{
+  Source *source;
+
+  g_return_if_fail (MESSAGING_MENU_IS_APP (app));
+  g_return_if_fail (source_id != NULL);
+
+  source = messaging_menu_app_get_source (app, source_id);
+  if (source)
+    {
+      source->expires = seconds ? g_get_monotonic_time () + (gint64) seconds * G_USEC_PER_SEC : 0;
+      messaging_menu_app_notify_time_to_live (app, "source", source->id, source->expires);
     }
 }
 
@@ -1345,21 +1872,29 @@ messaging_menu_app_append_message (MessagingMenuApp     *app,
                                    gboolean              notify)
 {
   const gchar *id;
+  GVariant *serialized_icon;
 
   g_return_if_fail (MESSAGING_MENU_IS_APP (app));
   g_return_if_fail (MESSAGING_MENU_IS_MESSAGE (msg));
 
   id = messaging_menu_message_get_id (msg);
 
-  if (g_hash_table_lookup (app->messages, id))
+  if (g_hash_table_contains (app->messages, id))
     {
       g_warning ("a message with id '%s' already exists", id);
       return;
     }
 
-  g_hash_table_insert (app->messages, g_strdup (id), g_object_ref (msg));
-  indicator_messages_application_emit_message_added (app->app_interface,
-                                                     _messaging_menu_message_to_variant (msg));
+  g_hash_table_insert (app->messages, g_strdup (id),
+                       g_sequence_insert_sorted (app->message_order, g_object_ref (msg),
+                                                 compare_messages, NULL));
+
+  serialized_icon = messaging_menu_app_serialize_icon (app, messaging_menu_message_get_icon (msg));
+  messaging_menu_app_emit_change (app, "MessageAdded",
+                                  g_variant_new ("(@(savsssxaa{sv}b))",
+                                                 _messaging_menu_message_to_variant (msg, serialized_icon)));
+  if (serialized_icon)
+    g_variant_unref (serialized_icon);
 
   if (source_id)
     {
@@ -1368,8 +1903,11 @@ messaging_menu_app_append_message (MessagingMenuApp     *app,
       source = messaging_menu_app_get_source (app, source_id);
       if (source && source->count >= 0)
         {
+          gboolean was_visible = source_is_visible (source);
+
           source->count++;
-          messaging_menu_app_notify_source_changed (app, source);
+          messaging_menu_app_notify_source_field (app, source, was_visible,
+                                                  "count", g_variant_new_uint32 (source->count));
         }
     }
 }
@@ -1392,7 +1930,7 @@ messaging_menu_app_get_message (MessagingMenuApp *app,
   g_return_val_if_fail (MESSAGING_MENU_IS_APP (app), NULL);
   g_return_val_if_fail (id != NULL, NULL);
 
-  return g_hash_table_lookup (app->messages, id);
+  return messaging_menu_app_lookup_message (app, id);
 }
 
 /**
@@ -1434,5 +1972,50 @@ messaging_menu_app_remove_message_by_id (MessagingMenuApp     *app,
   g_return_if_fail (id != NULL);
 
   if (messaging_menu_app_remove_message_internal (app, id))
-    indicator_messages_application_emit_message_removed (app->app_interface, id);
+    messaging_menu_app_emit_change (app, "MessageRemoved", g_variant_new ("(s)", id));
+}
+
+/**
+ * messaging_menu_app_set_message_time_to_live:
+ * @app: a #MessagingMenuApp
+ * @message_id: the id of a message that was added to @app
+ * @seconds: the number of seconds after which the message is removed,
+ *   or 0 to keep it until it is removed explicitly
+ *
+ * Makes the messaging menu remove the message with @message_id after
+ * @seconds, as if the user had dismissed it, in case the application
+ * doesn't get around to removing it.  Messaging menus which don't
+ * support this ignore it.
+ */
+void
+messaging_menu_app_set_message_time_to_live (MessagingMenuApp *app,
+                                             const gchar      *message_id,
+                                             guint             seconds)
+{
+  gint64 expires = 0;
+  gint64 *stored;
+
+  g_return_if_fail (MESSAGING_MENU_IS_APP (app));
+  g_return_if_fail (message_id != NULL);
+
+  if (!g_hash_table_contains (app->messages, message_id))
+    {
+      g_warning ("a message with id '%s' doesn't exist", message_id);
+      return;
+    }
+
+  if (seconds)
+    {
+      expires = g_get_monotonic_time () + (gint64) seconds * G_USEC_PER_SEC;
+
+      stored = g_new (gint64, 1);
+      *stored = expires;
+      g_hash_table_insert (app->message_expiries, g_strdup (message_id), stored);
+    }
+  else
+    {
+      g_hash_table_remove (app->message_expiries, message_id);
+    }
+
+  messaging_menu_app_notify_time_to_live (app, "message", message_id, expires);
 }
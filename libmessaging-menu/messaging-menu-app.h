@@ -144,6 +144,10 @@ void                messaging_menu_app_draw_attention            (MessagingMenuA
 void                messaging_menu_app_remove_attention          (MessagingMenuApp *app,
                                                                   const gchar      *source_id);
 
+void                messaging_menu_app_set_source_time_to_live   (MessagingMenuApp *app,
+                                                                  const gchar      *source_id,
+                                                                  guint             seconds);
+
 void                messaging_menu_app_append_message            (MessagingMenuApp     *app,
                                                                   MessagingMenuMessage *msg,
                                                                   const gchar          *source_id,
@@ -158,6 +162,10 @@ void                messaging_menu_app_remove_message            (MessagingMenuA
 void                messaging_menu_app_remove_message_by_id      (MessagingMenuApp     *app,
                                                                   const gchar          *id);
 
+void                messaging_menu_app_set_message_time_to_live  (MessagingMenuApp *app,
+                                                                  const gchar      *message_id,
+                                                                  guint             seconds);
+
 G_END_DECLS
 
 #endif
@@ -503,6 +503,7 @@ action_to_variant (Action *action)
 /*<internal>
  * _messaging_menu_message_to_variant:
  * @msg: a #MessagingMenuMessage
+ * @serialized_icon: (allow-none): the value to send for the icon of @msg
  *
  * Serializes @msg to a #GVariant of the form (savsssxaa{sv}b):
  *
@@ -518,22 +519,18 @@ action_to_variant (Action *action)
  * Returns: a new floating #GVariant instance
  */
 GVariant *
-_messaging_menu_message_to_variant (MessagingMenuMessage *msg)
+_messaging_menu_message_to_variant (MessagingMenuMessage *msg,
+                                    GVariant             *serialized_icon)
 {
   GVariantBuilder builder;
   GSList *it;
-  GVariant *serialized_icon;
   GVariantBuilder icon_builder;
 
   g_return_val_if_fail (MESSAGING_MENU_IS_MESSAGE (msg), NULL);
 
-  serialized_icon = msg->icon ? g_icon_serialize (msg->icon) : NULL;
   g_variant_builder_init (&icon_builder, G_VARIANT_TYPE ("av"));
   if (serialized_icon)
-    {
-      g_variant_builder_add (&icon_builder, "v", serialized_icon);
-      g_variant_unref (serialized_icon);
-    }
+    g_variant_builder_add (&icon_builder, "v", serialized_icon);
 
   g_variant_builder_init (&builder, G_VARIANT_TYPE ("(savsssxaa{sv}b)"));
   g_variant_builder_add (&builder, "s", msg->id);
@@ -23,10 +23,25 @@
 
 #include "im-accounts-service.h"
 
+/* SetXHasMessages is only called for real transitions, once the value
+   hasn't changed for DEBOUNCE_MS. Failed calls are retried after
+   RETRY_MIN_MS, doubling up to RETRY_MAX_MS. */
+#define DEBOUNCE_MS   200
+#define RETRY_MIN_MS  1000
+#define RETRY_MAX_MS  60000
+
 typedef struct {
     ActUserManager * user_manager;
+    gchar * user_path;          /* object path the proxy is for, or is being created for */
     GDBusProxy * touch_settings;
     GCancellable * cancel;
+
+    GCancellable * set_cancel;
+    gboolean draws_attention;   /* the value we want */
+    gint acked_draws_attention; /* the value accountsservice has, -1 if unknown */
+    gboolean sending;           /* a SetXHasMessages call is in flight */
+    guint flush_id;
+    guint retry_ms;
 } ImAccountsServicePrivate;
 
 static void im_accounts_service_class_init (ImAccountsServiceClass *klass);
@@ -36,9 +51,33 @@ static void im_accounts_service_finalize   (GObject *object);
 static void user_changed (ActUserManager * manager, ActUser * user, gpointer user_data);
 static void on_user_manager_loaded (ActUserManager * manager, GParamSpec * pspect, gpointer user_data);
 static void security_privacy_ready (GObject * obj, GAsyncResult * res, gpointer user_data);
+static void schedule_flush (ImAccountsService * self, guint delay_ms);
 
 G_DEFINE_TYPE_WITH_PRIVATE (ImAccountsService, im_accounts_service, G_TYPE_OBJECT);
 
+enum {
+    PROP_0,
+    PROP_SHOW_ON_GREETER,
+    NUM_PROPERTIES
+};
+
+static GParamSpec *properties[NUM_PROPERTIES];
+
+static void
+im_accounts_service_get_property (GObject *object, guint property_id, GValue *value, GParamSpec *pspec)
+{
+    ImAccountsService * self = IM_ACCOUNTS_SERVICE(object);
+
+    switch (property_id) {
+    case PROP_SHOW_ON_GREETER:
+        g_value_set_boolean(value, im_accounts_service_get_show_on_greeter(self));
+        break;
+
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+    }
+}
+
 static void
 im_accounts_service_class_init (ImAccountsServiceClass *klass)
 {
@@ -46,6 +85,13 @@ im_accounts_service_class_init (ImAccountsServiceClass *klass)
 
     object_class->dispose = im_accounts_service_dispose;
     object_class->finalize = im_accounts_service_finalize;
+    object_class->get_property = im_accounts_service_get_property;
+
+    properties[PROP_SHOW_ON_GREETER] = g_param_spec_boolean("show-on-greeter", "", "",
+                                                            FALSE,
+                                                            G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+    g_object_class_install_properties(object_class, NUM_PROPERTIES, properties);
 }
 
 static void
@@ -54,8 +100,23 @@ im_accounts_service_init (ImAccountsService *self)
     ImAccountsServicePrivate * priv = im_accounts_service_get_instance_private(self);
 
     priv->cancel = g_cancellable_new();
+    priv->set_cancel = g_cancellable_new();
+    priv->acked_draws_attention = -1;
+}
 
-    priv->user_manager = act_user_manager_get_default();
+/* Loading the user manager is expensive and most profiles never need it,
+   so it is only done once the greeter setting or the attention state is
+   asked for */
+static void
+ensure_user_manager (ImAccountsService * self)
+{
+    ImAccountsServicePrivate * priv = im_accounts_service_get_instance_private(self);
+
+    if (priv->user_manager != NULL) {
+        return;
+    }
+
+    priv->user_manager = g_object_ref(act_user_manager_get_default());
     g_signal_connect(priv->user_manager, "user-added", G_CALLBACK(user_changed), self);
     g_signal_connect(priv->user_manager, "user-changed", G_CALLBACK(user_changed), self);
     g_signal_connect(priv->user_manager, "notify::is-loaded", G_CALLBACK(on_user_manager_loaded), self);
@@ -63,7 +124,7 @@ im_accounts_service_init (ImAccountsService *self)
     gboolean isLoaded = FALSE;
     g_object_get(G_OBJECT(priv->user_manager), "is-loaded", &isLoaded, NULL);
     if (isLoaded) {
-        on_user_manager_loaded(priv->user_manager, NULL, NULL);
+        on_user_manager_loaded(priv->user_manager, NULL, self);
     }
 }
 
@@ -78,7 +139,22 @@ im_accounts_service_dispose (GObject *object)
         g_clear_object(&priv->cancel);
     }
 
-    g_clear_object(&priv->user_manager);
+    if (priv->set_cancel != NULL) {
+        g_cancellable_cancel(priv->set_cancel);
+        g_clear_object(&priv->set_cancel);
+    }
+
+    if (priv->flush_id != 0) {
+        g_source_remove(priv->flush_id);
+        priv->flush_id = 0;
+    }
+
+    g_clear_object(&priv->touch_settings);
+
+    if (priv->user_manager != NULL) {
+        g_signal_handlers_disconnect_by_data(priv->user_manager, self);
+        g_clear_object(&priv->user_manager);
+    }
 
     G_OBJECT_CLASS (im_accounts_service_parent_class)->dispose (object);
 }
@@ -86,6 +162,10 @@ im_accounts_service_dispose (GObject *object)
 static void
 im_accounts_service_finalize (GObject *object)
 {
+    ImAccountsServicePrivate * priv = im_accounts_service_get_instance_private(IM_ACCOUNTS_SERVICE(object));
+
+    g_free(priv->user_path);
+
     G_OBJECT_CLASS (im_accounts_service_parent_class)->finalize (object);
 }
 
@@ -99,11 +179,24 @@ user_changed (ActUserManager * manager, ActUser * user, gpointer user_data)
 
     ImAccountsService * self = IM_ACCOUNTS_SERVICE(user_data);
     ImAccountsServicePrivate * priv = im_accounts_service_get_instance_private(self);
+    const gchar * path = act_user_get_object_path(user);
+
+    /* Most changes are about other properties of the same user; the proxy
+       follows its own properties through g-properties-changed */
+    if (g_strcmp0(path, priv->user_path) == 0) {
+        return;
+    }
+
     g_debug("User Updated");
+    g_free(priv->user_path);
+    priv->user_path = g_strdup(path);
 
     /* Clear old proxies */
     g_clear_object(&priv->touch_settings);
 
+    /* A new user object doesn't know what we told the old one */
+    priv->acked_draws_attention = -1;
+
     g_cancellable_cancel(priv->cancel);
     g_clear_object(&priv->cancel);
     priv->cancel = g_cancellable_new();
@@ -113,13 +206,30 @@ user_changed (ActUserManager * manager, ActUser * user, gpointer user_data)
         G_DBUS_PROXY_FLAGS_NONE,
         NULL,
         "org.freedesktop.Accounts",
-        act_user_get_object_path(user),
+        path,
         "com.lomiri.touch.AccountsService.SecurityPrivacy",
         priv->cancel,
         security_privacy_ready,
         user_data);
 }
 
+/* The greeter menus re-project their items when the privacy setting changes */
+static void
+security_privacy_changed (GDBusProxy * proxy, GVariant * changed, GStrv invalidated, gpointer user_data)
+{
+    gboolean is_changed = g_variant_lookup(changed, "MessagesWelcomeScreen", "b", NULL);
+
+    for (guint i = 0; invalidated != NULL && invalidated[i] != NULL; i++) {
+        if (g_str_equal(invalidated[i], "MessagesWelcomeScreen")) {
+            is_changed = TRUE;
+        }
+    }
+
+    if (is_changed) {
+        g_object_notify_by_pspec(G_OBJECT(user_data), properties[PROP_SHOW_ON_GREETER]);
+    }
+}
+
 /* Respond to the async of setting up the proxy. Mostly we get it or we error. */
 static void
 security_privacy_ready (GObject * obj, GAsyncResult * res, gpointer user_data)
@@ -129,8 +239,13 @@ security_privacy_ready (GObject * obj, GAsyncResult * res, gpointer user_data)
 
     if (error != NULL) {
         if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            ImAccountsServicePrivate * priv = im_accounts_service_get_instance_private(IM_ACCOUNTS_SERVICE(user_data));
+
             g_warning("Unable to get a proxy on accounts service for touch settings: %s",
                       error->message);
+
+            /* Try again on the next change of the user */
+            g_clear_pointer(&priv->user_path, g_free);
         }
         g_error_free(error);
         return;
@@ -141,6 +256,12 @@ security_privacy_ready (GObject * obj, GAsyncResult * res, gpointer user_data)
     /* Ensure we didn't get a proxy while we weren't looking */
     g_clear_object(&priv->touch_settings);
     priv->touch_settings = proxy;
+
+    g_signal_connect(proxy, "g-properties-changed", G_CALLBACK(security_privacy_changed), self);
+    g_object_notify_by_pspec(G_OBJECT(self), properties[PROP_SHOW_ON_GREETER]);
+
+    /* Send what was set while we didn't have a proxy */
+    schedule_flush(self, 0);
 }
 
 /* When the user manager is loaded see if we have a user already loaded
@@ -176,30 +297,133 @@ im_accounts_service_ref_default (void)
     return g_object_ref(as);
 }
 
-/* The draws attention setting is very legacy right now, we've patched and not changed
-   things much. We're gonna do better in the future, this function abstracts out the ugly */
-void
-im_accounts_service_set_draws_attention (ImAccountsService * service, gboolean draws_attention)
+static gboolean flush_draws_attention (gpointer user_data);
+
+/* Only one flush is pending at a time; while a call is in flight its
+   reply schedules the next one */
+static void
+schedule_flush (ImAccountsService * self, guint delay_ms)
 {
-    g_return_if_fail(IM_IS_ACCOUNTS_SERVICE(service));
-    ImAccountsService * self = IM_ACCOUNTS_SERVICE(service);
     ImAccountsServicePrivate * priv = im_accounts_service_get_instance_private(self);
 
-    if (priv->touch_settings == NULL) {
+    if (priv->flush_id != 0 || priv->sending) {
+        return;
+    }
+
+    priv->flush_id = g_timeout_add(delay_ms, flush_draws_attention, self);
+}
+
+static void
+set_has_messages_done (GObject * obj, GAsyncResult * res, gpointer user_data)
+{
+    GError * error = NULL;
+    GVariant * reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(obj), res, &error);
+
+    if (error != NULL) {
+        if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            /* The service is gone, don't touch it */
+            g_error_free(error);
+            return;
+        }
+    }
+
+    ImAccountsService * self = IM_ACCOUNTS_SERVICE(user_data);
+    ImAccountsServicePrivate * priv = im_accounts_service_get_instance_private(self);
+    priv->sending = FALSE;
+
+    if (error != NULL) {
+        priv->acked_draws_attention = -1;
+        priv->retry_ms = CLAMP(priv->retry_ms * 2, RETRY_MIN_MS, RETRY_MAX_MS);
+        g_warning("Unable to set XHasMessages, retrying in %u ms: %s", priv->retry_ms, error->message);
+        g_error_free(error);
+
+        schedule_flush(self, priv->retry_ms);
         return;
     }
 
+    g_variant_unref(reply);
+    priv->retry_ms = 0;
+
+    /* The value may have changed again while we were waiting */
+    if (priv->acked_draws_attention != priv->draws_attention) {
+        schedule_flush(self, DEBOUNCE_MS);
+    }
+}
+
+static gboolean
+flush_draws_attention (gpointer user_data)
+{
+    ImAccountsService * self = IM_ACCOUNTS_SERVICE(user_data);
+    ImAccountsServicePrivate * priv = im_accounts_service_get_instance_private(self);
+
+    priv->flush_id = 0;
+
+    /* security_privacy_ready flushes once we have the user */
+    if (priv->touch_settings == NULL) {
+        return G_SOURCE_REMOVE;
+    }
+
+    if (priv->acked_draws_attention == priv->draws_attention) {
+        return G_SOURCE_REMOVE;
+    }
+
+    /* Assume it sticks, so that changes made while the call is in flight
+       are compared against it; a failure resets it */
+    priv->sending = TRUE;
+    priv->acked_draws_attention = priv->draws_attention;
+
     g_dbus_connection_call(g_dbus_proxy_get_connection(priv->touch_settings),
         g_dbus_proxy_get_name(priv->touch_settings),
         g_dbus_proxy_get_object_path(priv->touch_settings),
         "org.freedesktop.Accounts.User",
         "SetXHasMessages",
-        g_variant_new("(b)", draws_attention),
+        g_variant_new("(b)", priv->draws_attention),
         NULL, /* reply */
         G_DBUS_CALL_FLAGS_NONE,
         -1, /* timeout */
-        priv->cancel, /* cancellable */
-        NULL, NULL); /* cb */
+        priv->set_cancel, /* cancellable */
+        set_has_messages_done, self); /* cb */
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Restarts a pending debounce, so that bursts of changes are sent once
+   they are over. A pending retry keeps its backoff. */
+static void
+debounce_flush (ImAccountsService * self)
+{
+    ImAccountsServicePrivate * priv = im_accounts_service_get_instance_private(self);
+
+    if (priv->flush_id != 0 && priv->retry_ms == 0) {
+        g_source_remove(priv->flush_id);
+        priv->flush_id = 0;
+    }
+
+    schedule_flush(self, DEBOUNCE_MS);
+}
+
+/* The draws attention setting is very legacy right now, we've patched and not changed
+   things much. We're gonna do better in the future, this function abstracts out the ugly */
+void
+im_accounts_service_set_draws_attention (ImAccountsService * service, gboolean draws_attention)
+{
+    g_return_if_fail(IM_IS_ACCOUNTS_SERVICE(service));
+    ImAccountsService * self = IM_ACCOUNTS_SERVICE(service);
+    ImAccountsServicePrivate * priv = im_accounts_service_get_instance_private(self);
+
+    priv->draws_attention = draws_attention ? TRUE : FALSE;
+
+    /* Nothing to clear until we told accountsservice about messages */
+    if (priv->user_manager == NULL) {
+        if (!priv->draws_attention) {
+            return;
+        }
+        ensure_user_manager(self);
+    }
+
+    if (priv->acked_draws_attention != priv->draws_attention) {
+        debounce_flush(self);
+    }
 }
 
 /* Looks at the property that is set by settings. We default to off in any case
@@ -212,6 +436,10 @@ im_accounts_service_get_show_on_greeter (ImAccountsService * service)
     ImAccountsService * self = IM_ACCOUNTS_SERVICE(service);
     ImAccountsServicePrivate * priv = im_accounts_service_get_instance_private(self);
 
+    /* Until the proxy is ready this is FALSE; "show-on-greeter" is
+       notified once it is */
+    ensure_user_manager(self);
+
     if (priv->touch_settings == NULL) {
         return FALSE;
     }
@@ -0,0 +1,415 @@
+/*
+ * Copyright 2026 Ayatana Indicators
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "im-action-table.h"
+
+#include <string.h>
+
+/*
+ * ImActionTable is a GActionGroup for large numbers of uniform actions,
+ * such as the sources or messages of an application.  All actions share
+ * the parameter type and the activation callback of the table, and are
+ * kept in a single array sorted by name.  Instead of a GAction object
+ * with its own signal handlers, each action only costs its name, its
+ * (optional) state and a flag telling whether it draws attention.
+ *
+ * Requests to change the state of an action from the outside are
+ * ignored, states are only changed with im_action_table_set_state().
+ */
+
+typedef GObjectClass ImActionTableClass;
+
+typedef struct
+{
+  gchar *name;
+  GVariant *state;
+  gboolean draws_attention;
+} ImActionTableEntry;
+
+struct _ImActionTable
+{
+  GObject parent;
+
+  GVariantType *parameter_type;
+  ImActionTableActivateFunc activate;
+  gpointer user_data;
+
+  GArray *entries;  /* ImActionTableEntry, sorted by name */
+};
+
+static void im_action_table_group_iface_init (GActionGroupInterface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (ImActionTable, im_action_table, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (G_TYPE_ACTION_GROUP, im_action_table_group_iface_init));
+
+static void
+im_action_table_entry_clear (gpointer data)
+{
+  ImActionTableEntry *entry = data;
+
+  g_free (entry->name);
+  if (entry->state)
+    g_variant_unref (entry->state);
+}
+
+/* Looks for @name with a binary search.  Returns TRUE and its index in
+ * @index if it was found, or FALSE and the index at which it would have
+ * to be inserted. */
+static gboolean
+im_action_table_find (ImActionTable *table,
+                      const gchar   *name,
+                      guint         *index)
+{
+  guint lo = 0;
+  guint hi = table->entries->len;
+
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+      gint cmp;
+
+      cmp = strcmp (name, g_array_index (table->entries, ImActionTableEntry, mid).name);
+      if (cmp == 0)
+        {
+          *index = mid;
+          return TRUE;
+        }
+      else if (cmp < 0)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+
+  *index = lo;
+  return FALSE;
+}
+
+/* Emits "action-removed" while the action still exists, as
+ * GActionGroup requires, and removes it afterwards.  @name may point
+ * into the entry that is freed. */
+static void
+im_action_table_remove_action (ImActionTable *table,
+                               const gchar   *name)
+{
+  gchar *tmp;
+  guint index;
+
+  tmp = g_strdup (name);
+  g_action_group_action_removed (G_ACTION_GROUP (table), tmp);
+
+  /* handlers may have changed the table */
+  if (im_action_table_find (table, tmp, &index))
+    g_array_remove_index (table->entries, index);
+
+  g_free (tmp);
+}
+
+static gchar **
+im_action_table_list_actions (GActionGroup *group)
+{
+  ImActionTable *table = IM_ACTION_TABLE (group);
+  gchar **names;
+  guint i;
+
+  names = g_new (gchar *, table->entries->len + 1);
+  for (i = 0; i < table->entries->len; i++)
+    names[i] = g_strdup (g_array_index (table->entries, ImActionTableEntry, i).name);
+  names[i] = NULL;
+
+  return names;
+}
+
+static gboolean
+im_action_table_query_action (GActionGroup        *group,
+                              const gchar         *action_name,
+                              gboolean            *enabled,
+                              const GVariantType **parameter_type,
+                              const GVariantType **state_type,
+                              GVariant           **state_hint,
+                              GVariant           **state)
+{
+  ImActionTable *table = IM_ACTION_TABLE (group);
+  ImActionTableEntry *entry;
+  guint index;
+
+  if (!im_action_table_find (table, action_name, &index))
+    return FALSE;
+
+  entry = &g_array_index (table->entries, ImActionTableEntry, index);
+
+  if (enabled)
+    *enabled = TRUE;
+
+  if (parameter_type)
+    *parameter_type = table->parameter_type;
+
+  if (state_type)
+    *state_type = entry->state ? g_variant_get_type (entry->state) : NULL;
+
+  if (state_hint)
+    *state_hint = NULL;
+
+  if (state)
+    *state = entry->state ? g_variant_ref (entry->state) : NULL;
+
+  return TRUE;
+}
+
+static void
+im_action_table_change_action_state (GActionGroup *group,
+                                     const gchar  *action_name,
+                                     GVariant     *value)
+{
+  /* states belong to the applications, see above */
+  g_variant_unref (g_variant_ref_sink (value));
+}
+
+static void
+im_action_table_activate_action (GActionGroup *group,
+                                 const gchar  *action_name,
+                                 GVariant     *parameter)
+{
+  ImActionTable *table = IM_ACTION_TABLE (group);
+  guint index;
+
+  if (parameter)
+    g_variant_ref_sink (parameter);
+
+  if (!im_action_table_find (table, action_name, &index))
+    goto out;
+
+  if (table->parameter_type == NULL ?
+      parameter != NULL :
+      parameter == NULL || !g_variant_is_of_type (parameter, table->parameter_type))
+    {
+      g_warning ("invalid parameter for activating action '%s'", action_name);
+      goto out;
+    }
+
+  /* @action_name belongs to the caller, which keeps it valid even if
+   * the callback removes the action */
+  if (table->activate)
+    table->activate (table, action_name, parameter, table->user_data);
+
+out:
+  if (parameter)
+    g_variant_unref (parameter);
+}
+
+static void
+im_action_table_finalize (GObject *object)
+{
+  ImActionTable *table = IM_ACTION_TABLE (object);
+
+  g_array_unref (table->entries);
+  if (table->parameter_type)
+    g_variant_type_free (table->parameter_type);
+
+  G_OBJECT_CLASS (im_action_table_parent_class)->finalize (object);
+}
+
+static void
+im_action_table_class_init (ImActionTableClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = im_action_table_finalize;
+}
+
+static void
+im_action_table_group_iface_init (GActionGroupInterface *iface)
+{
+  iface->list_actions = im_action_table_list_actions;
+  iface->query_action = im_action_table_query_action;
+  iface->change_action_state = im_action_table_change_action_state;
+  iface->activate_action = im_action_table_activate_action;
+}
+
+static void
+im_action_table_init (ImActionTable *table)
+{
+  table->entries = g_array_new (FALSE, FALSE, sizeof (ImActionTableEntry));
+  g_array_set_clear_func (table->entries, im_action_table_entry_clear);
+}
+
+/*
+ * im_action_table_new:
+ * @parameter_type: (allow-none): the parameter type of all actions
+ * @activate: called when one of the actions is activated
+ * @user_data: passed to @activate
+ *
+ * Returns: (transfer full): a new, empty #ImActionTable
+ */
+ImActionTable *
+im_action_table_new (const GVariantType        *parameter_type,
+                     ImActionTableActivateFunc  activate,
+                     gpointer                   user_data)
+{
+  ImActionTable *table;
+
+  table = g_object_new (IM_TYPE_ACTION_TABLE, NULL);
+  table->parameter_type = parameter_type ? g_variant_type_copy (parameter_type) : NULL;
+  table->activate = activate;
+  table->user_data = user_data;
+
+  return table;
+}
+
+/*
+ * im_action_table_insert:
+ * @table: an #ImActionTable
+ * @name: the name of the action
+ * @state: (allow-none): the state of the action, or %NULL for a
+ *   stateless action
+ * @draws_attention: whether the action draws attention
+ *
+ * Adds an action to @table.  An existing action with the same name is
+ * replaced, just like g_action_map_add_action() does.
+ */
+void
+im_action_table_insert (ImActionTable *table,
+                        const gchar   *name,
+                        GVariant      *state,
+                        gboolean       draws_attention)
+{
+  ImActionTableEntry entry;
+  guint index;
+
+  g_return_if_fail (IM_IS_ACTION_TABLE (table));
+  g_return_if_fail (name != NULL);
+
+  while (im_action_table_find (table, name, &index))
+    im_action_table_remove_action (table, name);
+
+  entry.name = g_strdup (name);
+  entry.state = state ? g_variant_ref_sink (state) : NULL;
+  entry.draws_attention = draws_attention;
+  g_array_insert_val (table->entries, index, entry);
+
+  g_action_group_action_added (G_ACTION_GROUP (table), name);
+}
+
+/*
+ * im_action_table_remove:
+ * @table: an #ImActionTable
+ * @name: the name of the action
+ *
+ * Returns: %TRUE if there was an action called @name
+ */
+gboolean
+im_action_table_remove (ImActionTable *table,
+                        const gchar   *name)
+{
+  guint index;
+
+  g_return_val_if_fail (IM_IS_ACTION_TABLE (table), FALSE);
+  g_return_val_if_fail (name != NULL, FALSE);
+
+  if (!im_action_table_find (table, name, &index))
+    return FALSE;
+
+  im_action_table_remove_action (table, name);
+
+  return TRUE;
+}
+
+/*
+ * im_action_table_set_state:
+ * @table: an #ImActionTable
+ * @name: the name of the action
+ * @state: the new state
+ * @draws_attention: whether the action draws attention
+ *
+ * Changes the state and attention flag of an existing action.
+ * "action-state-changed" is only emitted if the state is different
+ * from the old one.
+ *
+ * Returns: %TRUE if there was an action called @name
+ */
+gboolean
+im_action_table_set_state (ImActionTable *table,
+                           const gchar   *name,
+                           GVariant      *state,
+                           gboolean       draws_attention)
+{
+  ImActionTableEntry *entry;
+  guint index;
+
+  g_return_val_if_fail (IM_IS_ACTION_TABLE (table), FALSE);
+  g_return_val_if_fail (name != NULL, FALSE);
+  g_return_val_if_fail (state != NULL, FALSE);
+
+  g_variant_ref_sink (state);
+
+  if (!im_action_table_find (table, name, &index))
+    {
+      g_variant_unref (state);
+      return FALSE;
+    }
+
+  entry = &g_array_index (table->entries, ImActionTableEntry, index);
+  entry->draws_attention = draws_attention;
+
+  if (entry->state && g_variant_equal (entry->state, state))
+    {
+      g_variant_unref (state);
+      return TRUE;
+    }
+
+  if (entry->state)
+    g_variant_unref (entry->state);
+  entry->state = state;
+
+  g_action_group_action_state_changed (G_ACTION_GROUP (table), name, state);
+
+  return TRUE;
+}
+
+/*
+ * im_action_table_lookup:
+ * @table: an #ImActionTable
+ * @name: the name of the action
+ * @draws_attention: (out) (allow-none): whether the action draws
+ *   attention, or %FALSE if there's no such action
+ *
+ * Returns: %TRUE if there is an action called @name
+ */
+gboolean
+im_action_table_lookup (ImActionTable *table,
+                        const gchar   *name,
+                        gboolean      *draws_attention)
+{
+  guint index;
+  gboolean found;
+
+  g_return_val_if_fail (IM_IS_ACTION_TABLE (table), FALSE);
+  g_return_val_if_fail (name != NULL, FALSE);
+
+  found = im_action_table_find (table, name, &index);
+
+  if (draws_attention)
+    *draws_attention = found && g_array_index (table->entries, ImActionTableEntry, index).draws_attention;
+
+  return found;
+}
+
+guint
+im_action_table_get_n_actions (ImActionTable *table)
+{
+  g_return_val_if_fail (IM_IS_ACTION_TABLE (table), 0);
+
+  return table->entries->len;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2026 Ayatana Indicators
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __IM_ACTION_TABLE_H__
+#define __IM_ACTION_TABLE_H__
+
+#include <gio/gio.h>
+
+#define IM_TYPE_ACTION_TABLE            (im_action_table_get_type ())
+#define IM_ACTION_TABLE(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), IM_TYPE_ACTION_TABLE, ImActionTable))
+#define IM_IS_ACTION_TABLE(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), IM_TYPE_ACTION_TABLE))
+
+typedef struct _ImActionTable ImActionTable;
+
+typedef void (*ImActionTableActivateFunc) (ImActionTable *table,
+                                           const gchar   *name,
+                                           GVariant      *parameter,
+                                           gpointer       user_data);
+
+GType                   im_action_table_get_type                (void);
+
+ImActionTable *         im_action_table_new                     (const GVariantType        *parameter_type,
+                                                                 ImActionTableActivateFunc  activate,
+                                                                 gpointer                   user_data);
+
+void                    im_action_table_insert                  (ImActionTable             *table,
+                                                                 const gchar               *name,
+                                                                 GVariant                  *state,
+                                                                 gboolean                   draws_attention);
+
+gboolean                im_action_table_remove                  (ImActionTable             *table,
+                                                                 const gchar               *name);
+
+gboolean                im_action_table_set_state               (ImActionTable             *table,
+                                                                 const gchar               *name,
+                                                                 GVariant                  *state,
+                                                                 gboolean                   draws_attention);
+
+gboolean                im_action_table_lookup                  (ImActionTable             *table,
+                                                                 const gchar               *name,
+                                                                 gboolean                  *draws_attention);
+
+guint                   im_action_table_get_n_actions           (ImActionTable             *table);
+
+#endif
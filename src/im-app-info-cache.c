@@ -0,0 +1,188 @@
+/*
+ * Copyright 2026 Ayatana Indicators
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "im-app-info-cache.h"
+
+/*
+ * ImAppInfoCache keeps the parsed desktop files of the applications the
+ * service has been asked about, as well as the default handlers of uri
+ * schemes.  Both g_desktop_app_info_new() and
+ * g_app_info_get_default_for_uri_scheme() read and parse files from
+ * disk on every call.
+ *
+ * Lookups that failed are cached as well.  Everything is dropped when
+ * the app info database changes (applications being installed, removed
+ * or updated, or default handlers being changed), after which the
+ * "changed" signal is emitted.
+ */
+
+typedef GObjectClass ImAppInfoCacheClass;
+
+struct _ImAppInfoCache
+{
+  GObject parent;
+
+  GAppInfoMonitor *monitor;
+  GHashTable *app_infos;  /* desktop id -> GDesktopAppInfo or NULL */
+  GHashTable *defaults;   /* uri scheme -> GAppInfo or NULL */
+};
+
+G_DEFINE_TYPE (ImAppInfoCache, im_app_info_cache, G_TYPE_OBJECT);
+
+enum
+{
+  CHANGED,
+  N_SIGNALS
+};
+
+static guint signals[N_SIGNALS];
+
+static void
+im_app_info_cache_monitor_changed (GAppInfoMonitor *monitor,
+                                   gpointer         user_data)
+{
+  ImAppInfoCache *cache = user_data;
+
+  g_hash_table_remove_all (cache->app_infos);
+  g_hash_table_remove_all (cache->defaults);
+
+  g_signal_emit (cache, signals[CHANGED], 0);
+}
+
+static void
+im_app_info_cache_dispose (GObject *object)
+{
+  ImAppInfoCache *cache = IM_APP_INFO_CACHE (object);
+
+  if (cache->monitor)
+    {
+      g_signal_handlers_disconnect_by_func (cache->monitor, im_app_info_cache_monitor_changed, cache);
+      g_clear_object (&cache->monitor);
+    }
+
+  g_clear_pointer (&cache->app_infos, g_hash_table_unref);
+  g_clear_pointer (&cache->defaults, g_hash_table_unref);
+
+  G_OBJECT_CLASS (im_app_info_cache_parent_class)->dispose (object);
+}
+
+static void
+im_app_info_cache_class_init (ImAppInfoCacheClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = im_app_info_cache_dispose;
+
+  signals[CHANGED] = g_signal_new ("changed",
+                                   IM_TYPE_APP_INFO_CACHE,
+                                   G_SIGNAL_RUN_FIRST,
+                                   0,
+                                   NULL, NULL,
+                                   g_cclosure_marshal_VOID__VOID,
+                                   G_TYPE_NONE,
+                                   0);
+}
+
+static void
+object_unref_if_not_null (gpointer data)
+{
+  if (data)
+    g_object_unref (data);
+}
+
+static void
+im_app_info_cache_init (ImAppInfoCache *cache)
+{
+  cache->app_infos = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, object_unref_if_not_null);
+  cache->defaults = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, object_unref_if_not_null);
+
+  cache->monitor = g_app_info_monitor_get ();
+  g_signal_connect (cache->monitor, "changed", G_CALLBACK (im_app_info_cache_monitor_changed), cache);
+}
+
+/* Gets a reference to the cache that is shared by the whole service */
+ImAppInfoCache *
+im_app_info_cache_ref_default (void)
+{
+  static ImAppInfoCache *cache = NULL;
+
+  if (cache == NULL)
+    {
+      cache = g_object_new (IM_TYPE_APP_INFO_CACHE, NULL);
+      g_object_add_weak_pointer (G_OBJECT (cache), (gpointer *) &cache);
+      return cache;
+    }
+
+  return g_object_ref (cache);
+}
+
+/*
+ * im_app_info_cache_lookup:
+ * @cache: an #ImAppInfoCache
+ * @desktop_id: a desktop file id
+ *
+ * Like g_desktop_app_info_new(), but only reads the desktop file if it
+ * hasn't been read before.
+ *
+ * Returns: (transfer full): a #GDesktopAppInfo, or %NULL if there's no
+ * application with @desktop_id
+ */
+GDesktopAppInfo *
+im_app_info_cache_lookup (ImAppInfoCache *cache,
+                          const gchar    *desktop_id)
+{
+  gpointer info;
+
+  g_return_val_if_fail (IM_IS_APP_INFO_CACHE (cache), NULL);
+  g_return_val_if_fail (desktop_id != NULL, NULL);
+
+  if (!g_hash_table_lookup_extended (cache->app_infos, desktop_id, NULL, &info))
+    {
+      info = g_desktop_app_info_new (desktop_id);
+      g_hash_table_insert (cache->app_infos, g_strdup (desktop_id), info);
+    }
+
+  return info ? g_object_ref (info) : NULL;
+}
+
+/*
+ * im_app_info_cache_get_default_for_uri_scheme:
+ * @cache: an #ImAppInfoCache
+ * @uri_scheme: a uri scheme, such as "mailto"
+ *
+ * Like g_app_info_get_default_for_uri_scheme(), but only queries the
+ * default handler for @uri_scheme if it hasn't been queried before.
+ *
+ * Returns: (transfer full): a #GAppInfo, or %NULL if there's no
+ * default handler for @uri_scheme
+ */
+GAppInfo *
+im_app_info_cache_get_default_for_uri_scheme (ImAppInfoCache *cache,
+                                              const gchar    *uri_scheme)
+{
+  gpointer info;
+
+  g_return_val_if_fail (IM_IS_APP_INFO_CACHE (cache), NULL);
+  g_return_val_if_fail (uri_scheme != NULL, NULL);
+
+  if (!g_hash_table_lookup_extended (cache->defaults, uri_scheme, NULL, &info))
+    {
+      info = g_app_info_get_default_for_uri_scheme (uri_scheme);
+      g_hash_table_insert (cache->defaults, g_strdup (uri_scheme), info);
+    }
+
+  return info ? g_object_ref (info) : NULL;
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright 2026 Ayatana Indicators
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __IM_APP_INFO_CACHE_H__
+#define __IM_APP_INFO_CACHE_H__
+
+#include <gio/gio.h>
+#include <gio/gdesktopappinfo.h>
+
+#define IM_TYPE_APP_INFO_CACHE            (im_app_info_cache_get_type ())
+#define IM_APP_INFO_CACHE(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), IM_TYPE_APP_INFO_CACHE, ImAppInfoCache))
+#define IM_IS_APP_INFO_CACHE(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), IM_TYPE_APP_INFO_CACHE))
+
+typedef struct _ImAppInfoCache ImAppInfoCache;
+
+GType                   im_app_info_cache_get_type                      (void);
+
+ImAppInfoCache *        im_app_info_cache_ref_default                   (void);
+
+GDesktopAppInfo *       im_app_info_cache_lookup                        (ImAppInfoCache *cache,
+                                                                         const gchar    *desktop_id);
+
+GAppInfo *              im_app_info_cache_get_default_for_uri_scheme    (ImAppInfoCache *cache,
+                                                                         const gchar    *uri_scheme);
+
+#endif
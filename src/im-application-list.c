@@ -23,6 +23,10 @@
 #include "gactionmuxer.h"
 #include "indicator-desktop-shortcuts.h"
 #include "im-accounts-service.h"
+#include "im-app-info-cache.h"
+#include "im-icon-store.h"
+#include "im-timer-wheel.h"
+#include "im-action-table.h"
 
 #include <gio/gdesktopappinfo.h>
 #include <string.h>
@@ -31,6 +35,28 @@
 
 typedef GObjectClass ImApplicationListClass;
 
+#define N_STATUSES 5
+#define STATUS_ID_OFFLINE  (G_N_ELEMENTS(status_ids) - 1)
+static const gchar *status_ids[N_STATUSES] = { "available", "away", "busy", "invisible", "offline" };
+
+static guint
+status2val (const gchar * string)
+{
+	if (string == NULL) return STATUS_ID_OFFLINE;
+
+	guint i;
+	for (i = 0; i < G_N_ELEMENTS(status_ids); i++) {
+		if (g_strcmp0(status_ids[i], string) == 0) {
+			break;
+		}
+	}
+
+	if (i > STATUS_ID_OFFLINE)
+		i = STATUS_ID_OFFLINE;
+
+	return i;
+}
+
 struct _ImApplicationList
 {
   GObject parent;
@@ -38,16 +64,54 @@ struct _ImApplicationList
   GHashTable *applications;
   GActionMuxer *muxer;
 
+  /* Signals of all remote applications arrive through one subscription
+   * and are routed by sender.  Maps unique bus names to lists of
+   * Application, as one process may register several applications.
+   * Each of those names is watched on its own, so that the service isn't
+   * woken up by every name change on the bus. */
+  GDBusConnection *connection;
+  GHashTable *remotes;
+  GHashTable *remote_watches; /* unique bus name -> name watcher id */
+  guint app_signals_id;
+
   GSimpleActionGroup * globalactions;
   GSimpleAction * statusaction;
 
   GHashTable *app_status;
 
   ImAccountsService * as;
+  ImAppInfoCache *app_infos;
+  ImIconStore *icon_store;
+
+  /* sums of the counters of all applications */
+  guint n_items;
+  guint n_attention_sources;
+  guint n_attention_messages;
+
+  /* every possible state of the "messages" action, indexed by status,
+   * attention and visibility, and the one that was published last */
+  GVariant *root_states[N_STATUSES][2][2];
+  GVariant *root_state;
+  gint published_attention; /* -1 if not published yet */
+  guint root_action_idle;
+
+  /* Messages of all applications, oldest first, for evicting them when
+   * there are more than the "max-messages" and
+   * "max-messages-per-application" settings allow (0 for no limit) */
+  GSettings *settings;
+  GSequence *message_order;
+  guint max_messages;
+  guint max_messages_per_app;
+  guint messages_wanted;  /* see im_application_list_set_messages_wanted() */
+  guint n_evicted;
+  guint n_evicted_unreported;
+  guint report_evictions_idle;
+
+  /* expires sources and messages which were given a time to live */
+  ImTimerWheel *expiry_wheel;
 };
 
 G_DEFINE_TYPE (ImApplicationList, im_application_list, G_TYPE_OBJECT);
-G_DEFINE_QUARK (draws_attention, message_action_draws_attention);
 
 enum
 {
@@ -59,6 +123,7 @@ enum
   APP_ADDED,
   APP_STOPPED,
   REMOVE_ALL,
+  SHOW_MORE_MESSAGES,
   STATUS_SET,
   N_SIGNALS
 };
@@ -70,21 +135,403 @@ typedef struct
   ImApplicationList *list;
   GDesktopAppInfo *info;
   gchar *id;
-  IndicatorMessagesApplication *proxy;
+  IndicatorMessagesApplication *proxy;  /* only used for method calls */
+  gchar *bus_name;
+  gchar *object_path;
   GActionMuxer *muxer;
-  GSimpleActionGroup *source_actions;
-  GSimpleActionGroup *message_actions;
+  ImActionTable *source_actions;
+  ImActionTable *message_actions;
   GActionMuxer *message_sub_actions;
   GCancellable *cancellable;
-  gboolean draws_attention;
   IndicatorDesktopShortcuts * shortcuts;
+
+  /* the serialized symbolic icon of the application, built on first
+   * use and dropped when the desktop file changes */
+  GVariant *serialized_app_icon;
+  gboolean app_icon_valid;
+
+  /* AppIcon by hash, for the icons uploaded with IconAdded; NULL until
+   * the first upload.  Icons that no source or message uses anymore are
+   * collected in released_icons and handed back to the application
+   * with ReleaseIcons from idle. */
+  GHashTable *icons;
+  GPtrArray *released_icons;
+  guint release_icons_idle;
+
+  /* MessageEntry by action name, and the same entries oldest first */
+  GHashTable *message_entries;
+  GSequence *message_order;
+
+  /* where ListMessagesPage continues, or NULL if all messages were
+   * listed, and whether any of the rest draws attention.  Pages are
+   * only fetched while the menus need more messages. */
+  gchar *messages_cursor;
+  gboolean messages_attention_after;
+  gboolean listing_messages;  /* a ListMessagesPage call is in flight */
+
+  /* SourceEntry by action name, and the same entries in the order the
+   * sources were added */
+  GHashTable *source_entries;
+  GSequence *source_order;
+
+  /* Expiry by action name; NULL until the first TimeToLiveSet */
+  GHashTable *source_expiries;
+  GHashTable *message_expiries;
+
+  /* kept up to date on every add, change and removal, so that neither
+   * attention nor "remove-all" need to look at the action groups */
+  guint n_items;
+  guint n_attention_sources;
+  guint n_attention_messages;
 } Application;
 
+/* An icon uploaded by an application.  The serialized icon is shared
+ * through the list's icon store; users counts the sources and messages
+ * that refer to it. */
+typedef struct
+{
+  GVariant *shared;
+  guint users;
+  gboolean releasing;  /* waiting for ReleaseIcons to return */
+} AppIcon;
+
+/* A source or message that is removed when its time to live is up */
+typedef struct
+{
+  Application *app;
+  gchar *action_name;
+  gboolean is_message;
+  ImTimerWheelEntry *entry;  /* NULL once it fired */
+} Expiry;
+
+/* A message in the eviction order of its application and of the list */
+typedef struct
+{
+  Application *app;
+  gchar *action_name;
+  gint64 time;
+  gboolean draws_attention;
+  GSequenceIter *app_iter;
+  GSequenceIter *list_iter;
+
+  /* what the menus show, for replaying it with
+   * im_application_list_foreach_message() */
+  GVariant *serialized_icon;
+  gchar *icon_hash;  /* if the icon was uploaded */
+  gchar *title;
+  gchar *subtitle;
+  gchar *body;
+  GVariant *actions;
+} MessageEntry;
+
+/* What the menus show of a source, for replaying it with
+ * im_application_list_foreach_source() */
+typedef struct
+{
+  Application *app;
+  gchar *action_name;
+  gchar *label;
+  GVariant *serialized_icon;
+  gchar *icon_hash;  /* if the icon was uploaded */
+  gboolean visible;
+  GSequenceIter *iter;
+} SourceEntry;
+
 
 /* Prototypes */
 static void         status_activated           (GSimpleAction *    action,
                                                 GVariant *         param,
                                                 gpointer           user_data);
+static void         im_application_list_source_activated  (ImActionTable *table,
+                                                           const gchar   *action_name,
+                                                           GVariant      *parameter,
+                                                           gpointer       user_data);
+static void         im_application_list_message_activated (ImActionTable *table,
+                                                           const gchar   *action_name,
+                                                           GVariant      *parameter,
+                                                           gpointer       user_data);
+static void         im_application_list_unset_remote      (Application   *app);
+static void         application_release_icon              (Application   *app,
+                                                           const gchar   *hash);
+static void         application_fetch_more_messages       (Application   *app);
+
+static void
+unwatch_name (gpointer data)
+{
+  g_bus_unwatch_name (GPOINTER_TO_UINT (data));
+}
+
+/* Forgets about the remote side of @app, without touching its sources
+ * and messages. */
+static void
+application_clear_remote (Application *app)
+{
+  if (app->cancellable)
+    {
+      g_cancellable_cancel (app->cancellable);
+      g_clear_object (&app->cancellable);
+    }
+
+  g_clear_object (&app->proxy);
+
+  if (app->bus_name)
+    {
+      GList *apps;
+      GList *remaining;
+
+      apps = g_hash_table_lookup (app->list->remotes, app->bus_name);
+      remaining = g_list_remove (apps, app);
+      if (remaining == NULL)
+        {
+          g_hash_table_remove (app->list->remotes, app->bus_name);
+          g_hash_table_remove (app->list->remote_watches, app->bus_name);
+        }
+      else if (remaining != apps)
+        g_hash_table_insert (app->list->remotes, g_strdup (app->bus_name), remaining);
+
+      g_clear_pointer (&app->bus_name, g_free);
+    }
+
+  g_clear_pointer (&app->object_path, g_free);
+
+  g_clear_pointer (&app->messages_cursor, g_free);
+  app->messages_attention_after = FALSE;
+  app->listing_messages = FALSE;
+
+  /* the next instance of the application uploads its icons again */
+  if (app->icons)
+    {
+      GHashTableIter iter;
+      gpointer hash;
+      MessageEntry *message;
+      SourceEntry *source;
+
+      g_hash_table_iter_init (&iter, app->icons);
+      while (g_hash_table_iter_next (&iter, &hash, NULL))
+        im_icon_store_release (app->list->icon_store, hash);
+
+      g_clear_pointer (&app->icons, g_hash_table_unref);
+
+      /* sources and messages keep their icons, but don't refer to
+       * uploads anymore */
+      g_hash_table_iter_init (&iter, app->message_entries);
+      while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &message))
+        g_clear_pointer (&message->icon_hash, g_free);
+
+      g_hash_table_iter_init (&iter, app->source_entries);
+      while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &source))
+        g_clear_pointer (&source->icon_hash, g_free);
+    }
+
+  if (app->release_icons_idle)
+    {
+      g_source_remove (app->release_icons_idle);
+      app->release_icons_idle = 0;
+    }
+  g_clear_pointer (&app->released_icons, g_ptr_array_unref);
+}
+
+static void
+expiry_free (gpointer data)
+{
+  Expiry *expiry = data;
+
+  if (expiry->entry)
+    im_timer_wheel_remove (expiry->app->list->expiry_wheel, expiry->entry);
+
+  g_free (expiry->action_name);
+  g_slice_free (Expiry, expiry);
+}
+
+static void
+application_clear_expiry (Application *app,
+                          gboolean     is_message,
+                          const gchar *action_name)
+{
+  GHashTable *expiries = is_message ? app->message_expiries : app->source_expiries;
+
+  if (expiries)
+    g_hash_table_remove (expiries, action_name);
+}
+
+static void
+application_clear_all_expiries (Application *app)
+{
+  g_clear_pointer (&app->source_expiries, g_hash_table_unref);
+  g_clear_pointer (&app->message_expiries, g_hash_table_unref);
+}
+
+static void
+message_entry_free (gpointer data)
+{
+  MessageEntry *entry = data;
+
+  application_release_icon (entry->app, entry->icon_hash);
+
+  g_free (entry->action_name);
+  if (entry->serialized_icon)
+    g_variant_unref (entry->serialized_icon);
+  g_free (entry->icon_hash);
+  g_free (entry->title);
+  g_free (entry->subtitle);
+  g_free (entry->body);
+  if (entry->actions)
+    g_variant_unref (entry->actions);
+  g_slice_free (MessageEntry, entry);
+}
+
+/* Oldest first; ties are broken by name and application, so that the
+ * order doesn't depend on insertion order */
+static gint
+message_entry_compare (gconstpointer a,
+                       gconstpointer b,
+                       gpointer      user_data)
+{
+  const MessageEntry *entry_a = a;
+  const MessageEntry *entry_b = b;
+  gint cmp;
+
+  if (entry_a->time != entry_b->time)
+    return entry_a->time < entry_b->time ? -1 : 1;
+
+  cmp = strcmp (entry_a->action_name, entry_b->action_name);
+  if (cmp != 0 || entry_a->app == entry_b->app)
+    return cmp;
+
+  return entry_a->app < entry_b->app ? -1 : 1;
+}
+
+static void
+application_unindex_message (Application *app,
+                             const gchar *action_name)
+{
+  MessageEntry *entry;
+
+  entry = g_hash_table_lookup (app->message_entries, action_name);
+  if (entry)
+    {
+      g_sequence_remove (entry->app_iter);
+      g_sequence_remove (entry->list_iter);
+      g_hash_table_remove (app->message_entries, entry->action_name);
+    }
+}
+
+static void
+application_index_message (Application *app,
+                           const gchar *action_name,
+                           gint64       time,
+                           gboolean     draws_attention)
+{
+  MessageEntry *entry;
+
+  application_unindex_message (app, action_name);
+
+  entry = g_slice_new0 (MessageEntry);
+  entry->app = app;
+  entry->action_name = g_strdup (action_name);
+  entry->time = time;
+  entry->draws_attention = draws_attention;
+  entry->app_iter = g_sequence_insert_sorted (app->message_order, entry, message_entry_compare, NULL);
+  entry->list_iter = g_sequence_insert_sorted (app->list->message_order, entry, message_entry_compare, NULL);
+
+  g_hash_table_insert (app->message_entries, entry->action_name, entry);
+}
+
+/* Takes the icon use of @icon_hash */
+static void
+application_store_message (Application *app,
+                           const gchar *action_name,
+                           GVariant    *serialized_icon,
+                           gchar       *icon_hash,
+                           const gchar *title,
+                           const gchar *subtitle,
+                           const gchar *body,
+                           GVariant    *actions)
+{
+  MessageEntry *entry;
+
+  entry = g_hash_table_lookup (app->message_entries, action_name);
+  if (entry == NULL)
+    {
+      application_release_icon (app, icon_hash);
+      g_free (icon_hash);
+      g_return_if_reached ();
+    }
+
+  entry->serialized_icon = serialized_icon ? g_variant_ref (serialized_icon) : NULL;
+  entry->icon_hash = icon_hash;
+  entry->title = g_strdup (title);
+  entry->subtitle = g_strdup (subtitle);
+  entry->body = g_strdup (body);
+  entry->actions = actions ? g_variant_ref_sink (actions) : NULL;
+}
+
+static void
+application_unindex_all_messages (Application *app)
+{
+  GHashTableIter iter;
+  MessageEntry *entry;
+
+  g_hash_table_iter_init (&iter, app->message_entries);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+    g_sequence_remove (entry->list_iter);
+
+  g_sequence_remove_range (g_sequence_get_begin_iter (app->message_order),
+                           g_sequence_get_end_iter (app->message_order));
+  g_hash_table_remove_all (app->message_entries);
+}
+
+static void
+source_entry_free (gpointer data)
+{
+  SourceEntry *entry = data;
+
+  application_release_icon (entry->app, entry->icon_hash);
+
+  g_sequence_remove (entry->iter);
+  g_free (entry->action_name);
+  g_free (entry->label);
+  if (entry->serialized_icon)
+    g_variant_unref (entry->serialized_icon);
+  g_free (entry->icon_hash);
+  g_slice_free (SourceEntry, entry);
+}
+
+/* Remembers how the menus show the source @action_name, taking the icon
+ * use of @icon_hash.  A source that is stored again keeps its place. */
+static void
+application_store_source (Application *app,
+                          const gchar *action_name,
+                          const gchar *label,
+                          GVariant    *serialized_icon,
+                          gchar       *icon_hash,
+                          gboolean     visible)
+{
+  SourceEntry *entry;
+
+  entry = g_hash_table_lookup (app->source_entries, action_name);
+  if (entry)
+    {
+      application_release_icon (app, entry->icon_hash);
+      g_free (entry->icon_hash);
+      g_free (entry->label);
+      if (entry->serialized_icon)
+        g_variant_unref (entry->serialized_icon);
+    }
+  else
+    {
+      entry = g_slice_new (SourceEntry);
+      entry->app = app;
+      entry->action_name = g_strdup (action_name);
+      entry->iter = g_sequence_append (app->source_order, entry);
+      g_hash_table_insert (app->source_entries, entry->action_name, entry);
+    }
+
+  entry->label = g_strdup (label);
+  entry->serialized_icon = serialized_icon ? g_variant_ref (serialized_icon) : NULL;
+  entry->icon_hash = icon_hash;
+  entry->visible = visible;
+}
 
 static void
 application_free (gpointer data)
@@ -97,14 +544,7 @@ application_free (gpointer data)
   g_object_unref (app->info);
   g_free (app->id);
 
-  if (app->cancellable)
-    {
-      g_cancellable_cancel (app->cancellable);
-      g_clear_object (&app->cancellable);
-    }
-
-  if (app->proxy)
-    g_object_unref (app->proxy);
+  application_clear_remote (app);
 
   if (app->muxer)
     {
@@ -115,27 +555,83 @@ application_free (gpointer data)
     }
 
   g_clear_object (&app->shortcuts);
+  g_clear_pointer (&app->serialized_app_icon, g_variant_unref);
+
+  application_clear_all_expiries (app);
+
+  if (app->message_entries)
+    {
+      application_unindex_all_messages (app);
+      g_hash_table_unref (app->message_entries);
+      g_sequence_free (app->message_order);
+    }
+
+  if (app->source_entries)
+    {
+      /* the entries remove themselves from the sequence */
+      g_hash_table_unref (app->source_entries);
+      g_sequence_free (app->source_order);
+    }
 
   g_slice_free (Application, app);
 }
 
-/* Check to see if we have actions by getting the full list of
-   names and see if there is one.  Not exactly efficient :-/ */
+#define SWAR_ONES  G_GUINT64_CONSTANT (0x0101010101010101)
+#define SWAR_HIGHS G_GUINT64_CONSTANT (0x8080808080808080)
+
+/* Sets the high bit of every byte in @word that lies in [lo, hi].  All
+ * bytes of @word must be below 0x80, so that the additions never carry
+ * into the next byte. */
+static inline guint64
+swar_bytes_in_range (guint64 word,
+                     guchar  lo,
+                     guchar  hi)
+{
+  return (word + SWAR_ONES * (0x80 - lo)) & ~(word + SWAR_ONES * (0x7f - hi)) & SWAR_HIGHS;
+}
+
+/* Returns TRUE if @name only consists of characters which are valid in
+ * action names and thus doesn't need escaping.  Looks at eight bytes at
+ * a time, as most ids are long enough for that to pay off. */
 static gboolean
-_g_action_group_has_actions (GActionGroup * ag)
+action_name_is_plain (const gchar *name)
 {
-  gchar ** list = NULL;
-  gboolean retval = FALSE;
+  gsize len = strlen (name);
+  gsize i;
+
+  for (i = 0; i + 8 <= len; i += 8)
+    {
+      guint64 word;
+      guint64 valid;
+
+      memcpy (&word, name + i, 8);
+      if (word & SWAR_HIGHS)
+        return FALSE;
+
+      valid = swar_bytes_in_range (word, '0', '9') |
+              swar_bytes_in_range (word, 'A', 'Z') |
+              swar_bytes_in_range (word, 'a', 'z') |
+              swar_bytes_in_range (word, '.', '.');
+      if (valid != SWAR_HIGHS)
+        return FALSE;
+    }
 
-  list = g_action_group_list_actions(ag);
-  retval = (list[0] != NULL);
-  g_strfreev(list);
+  for (; i < len; i++)
+    {
+      if (!g_ascii_isalnum (name[i]) && name[i] != '.')
+        return FALSE;
+    }
 
-  return retval;
+  return TRUE;
 }
 
-static gchar *
-escape_action_name (const gchar *name)
+/* Escapes @name for use as an action name.  Most ids don't need any
+ * escaping, in which case @name itself is returned.  Otherwise, the
+ * escaped name is returned and also stored in @tmp, which the caller
+ * has to free. */
+static const gchar *
+escape_action_name (const gchar  *name,
+                    gchar       **tmp)
 {
   static const gchar *xdigits = "0123456789abcdef";
   GString *escaped;
@@ -143,6 +639,10 @@ escape_action_name (const gchar *name)
 
   g_return_val_if_fail (name != NULL, NULL);
 
+  *tmp = NULL;
+  if (action_name_is_plain (name))
+    return name;
+
   escaped = g_string_new (NULL);
   while ((c = *name++))
     {
@@ -158,17 +658,25 @@ escape_action_name (const gchar *name)
         }
     }
 
-  return g_string_free (escaped, FALSE);
+  *tmp = g_string_free (escaped, FALSE);
+  return *tmp;
 }
 
-static gchar *
-unescape_action_name (const gchar *name)
+/* The reverse of escape_action_name(), with the same ownership rules:
+ * names without escape sequences are returned as they are. */
+static const gchar *
+unescape_action_name (const gchar  *name,
+                      gchar       **tmp)
 {
   GString *unescaped;
   gint i;
 
   g_return_val_if_fail (name != NULL, NULL);
 
+  *tmp = NULL;
+  if (strchr (name, '-') == NULL)
+    return name;
+
   unescaped = g_string_new (NULL);
   for (i = 0; name[i]; i++)
     {
@@ -187,34 +695,87 @@ unescape_action_name (const gchar *name)
         }
     }
 
-  return g_string_free (unescaped, FALSE);
+  *tmp = g_string_free (unescaped, FALSE);
+  return *tmp;
 }
 
-/* Check to see if either of our action groups has any actions, if
-   so return TRUE so we get chosen! */
-static gboolean
-application_has_items (gpointer key,
-                       gpointer value,
-                       gpointer user_data)
+/* Adds the given deltas to the item and attention counters of @app
+ * and to the list-wide sums. */
+static void
+application_update_counters (Application *app,
+                             gint         items,
+                             gint         attention_sources,
+                             gint         attention_messages)
 {
-  Application *app = value;
+  app->n_items += items;
+  app->n_attention_sources += attention_sources;
+  app->n_attention_messages += attention_messages;
 
-  return _g_action_group_has_actions(G_ACTION_GROUP(app->source_actions)) ||
-    _g_action_group_has_actions(G_ACTION_GROUP(app->message_actions));
+  app->list->n_items += items;
+  app->list->n_attention_sources += attention_sources;
+  app->list->n_attention_messages += attention_messages;
 }
 
-static gboolean
-application_draws_attention (gpointer key,
-                             gpointer value,
-                             gpointer user_data)
+static void
+application_clear_counters (Application *app)
 {
-  Application *app = value;
-
-  return app->draws_attention;
+  application_update_counters (app,
+                               -(gint) app->n_items,
+                               -(gint) app->n_attention_sources,
+                               -(gint) app->n_attention_messages);
 }
 
+/* Drops all sources and messages of @app at once, by replacing its
+ * action groups with empty ones in the muxer. */
 static void
-im_application_list_update_root_action (ImApplicationList *list)
+application_reset_actions (Application *app)
+{
+  g_object_unref (app->source_actions);
+  g_object_unref (app->message_actions);
+  g_object_unref (app->message_sub_actions);
+  app->source_actions = im_action_table_new (G_VARIANT_TYPE_BOOLEAN, im_application_list_source_activated, app);
+  app->message_actions = im_action_table_new (G_VARIANT_TYPE_BOOLEAN, im_application_list_message_activated, app);
+  app->message_sub_actions = g_action_muxer_new ();
+  g_action_muxer_insert (app->muxer, "src", G_ACTION_GROUP (app->source_actions));
+  g_action_muxer_insert (app->muxer, "msg", G_ACTION_GROUP (app->message_actions));
+  g_action_muxer_insert (app->muxer, "msg-actions", G_ACTION_GROUP (app->message_sub_actions));
+
+  application_unindex_all_messages (app);
+  g_hash_table_remove_all (app->source_entries);
+  application_clear_all_expiries (app);
+  application_clear_counters (app);
+}
+
+/* Returns the unescaped names of all actions in @group, which are the
+ * ids the application uses for them. */
+static gchar **
+action_group_list_ids (GActionGroup *group)
+{
+  gchar **names;
+  guint i;
+
+  names = g_action_group_list_actions (group);
+  for (i = 0; names[i]; i++)
+    {
+      gchar *id;
+
+      unescape_action_name (names[i], &id);
+      if (id)
+        {
+          g_free (names[i]);
+          names[i] = id;
+        }
+    }
+
+  return names;
+}
+
+/* Builds the state of the "messages" action for one combination of
+ * chat status, attention and visibility. */
+static GVariant *
+im_application_list_build_root_state (const gchar *status,
+                                      gboolean     draws_attention,
+                                      gboolean     visible)
 {
   const gchar *base_icon_name;
   const gchar *accessible_name;
@@ -222,24 +783,18 @@ im_application_list_update_root_action (ImApplicationList *list)
   GIcon * icon;
   GVariant *serialized_icon;
   GVariantBuilder builder;
-  GVariant *state;
-  guint n_applications;
 
   /* Figure out what type of icon we should be drawing */
-  if (g_hash_table_find (list->applications, application_draws_attention, NULL)) {
+  if (draws_attention) {
     base_icon_name = "indicator-messages-new-%s";
     accessible_name = _("New Messages");
-    im_accounts_service_set_draws_attention(list->as, TRUE);
   } else {
     base_icon_name = "indicator-messages-%s";
     accessible_name = _("Messages");
-    im_accounts_service_set_draws_attention(list->as, FALSE);
   }
 
   /* Include the IM state in the icon */
-  state = g_action_group_get_action_state(G_ACTION_GROUP(list->globalactions), "status");
-  icon_name = g_strdup_printf(base_icon_name, g_variant_get_string(state, NULL));
-  g_variant_unref(state);
+  icon_name = g_strdup_printf(base_icon_name, status);
 
   /* Build up the dictionary of values for the state */
   g_variant_builder_init(&builder, G_VARIANT_TYPE_DICTIONARY);
@@ -265,95 +820,87 @@ im_application_list_update_root_action (ImApplicationList *list)
   g_variant_builder_close(&builder);
 
   /* visibility */
-  n_applications = g_hash_table_size (list->applications);
-  g_variant_builder_add (&builder, "{sv}", "visible", g_variant_new_boolean (n_applications > 0));
-
-  /* Set the state */
-  g_action_group_change_action_state (G_ACTION_GROUP(list->globalactions), "messages", g_variant_builder_end(&builder));
+  g_variant_builder_add (&builder, "{sv}", "visible", g_variant_new_boolean (visible));
 
-  GAction * remove_action = g_action_map_lookup_action (G_ACTION_MAP (list->globalactions), "remove-all");
-  if (g_hash_table_find (list->applications, application_has_items, NULL)) {
-    g_debug("Enabling remove-all");
-    g_simple_action_set_enabled(G_SIMPLE_ACTION(remove_action), TRUE);
-  } else {
-    g_debug("Disabling remove-all");
-    g_simple_action_set_enabled(G_SIMPLE_ACTION(remove_action), FALSE);
-  }
+  return g_variant_ref_sink (g_variant_builder_end (&builder));
 }
 
-/* Check a source action to see if it draws */
-static gboolean
-app_source_action_check_draw (Application * app, const gchar * action_name)
+/* Publishes the state of the root action, the "remove-all" action and
+ * the accounts service attention flag.  Only values which differ from
+ * what was published before are sent out. */
+static void
+im_application_list_flush_root_action (ImApplicationList *list)
 {
-  GVariant *state;
-  guint32 count;
-  gint64 time;
-  const gchar *string;
+  GVariant *status;
+  guint status_id;
   gboolean draws_attention;
+  gboolean visible;
+  GVariant *state;
 
-  state = g_action_group_get_action_state (G_ACTION_GROUP(app->source_actions), action_name);
-  if (state == NULL)
-    return FALSE;
-  if (!g_variant_is_of_type(state, G_VARIANT_TYPE("(uxsb)")))
-    return FALSE;
-
-  g_variant_get (state, "(ux&sb)", &count, &time, &string, &draws_attention);
+  draws_attention = list->n_attention_sources > 0 || list->n_attention_messages > 0;
+  visible = g_hash_table_size (list->applications) > 0;
 
-  /* invisible sources do not draw attention */
-  if (count == 0 && time == 0 && (string == NULL || string[0] == '\0'))
-    draws_attention = FALSE;
+  status = g_action_group_get_action_state(G_ACTION_GROUP(list->globalactions), "status");
+  status_id = status2val(g_variant_get_string(status, NULL));
+  g_variant_unref(status);
 
-  g_variant_unref(state);
+  state = list->root_states[status_id][draws_attention][visible];
+  if (state != list->root_state)
+    {
+      list->root_state = state;
+      g_action_group_change_action_state (G_ACTION_GROUP(list->globalactions), "messages", state);
+    }
 
-  return draws_attention;
-}
+  if (draws_attention != list->published_attention)
+    {
+      list->published_attention = draws_attention;
+      im_accounts_service_set_draws_attention(list->as, draws_attention);
+    }
 
-/* Check a message action to see if it draws */
-static gboolean
-app_message_action_check_draw (Application * app, const gchar * action_name)
-{
-  GAction * action = NULL;
-  action = g_action_map_lookup_action (G_ACTION_MAP (app->message_actions), action_name);
-  return GPOINTER_TO_INT(g_object_get_qdata(G_OBJECT(action), message_action_draws_attention_quark()));
+  GAction * remove_action = g_action_map_lookup_action (G_ACTION_MAP (list->globalactions), "remove-all");
+  if ((list->n_items > 0) != g_action_get_enabled (remove_action)) {
+    g_debug("%s remove-all", list->n_items > 0 ? "Enabling" : "Disabling");
+    g_simple_action_set_enabled(G_SIMPLE_ACTION(remove_action), list->n_items > 0);
+  }
 }
 
-/* Regenerate the draw attention flag based on the sources and messages
- * that we have in the action groups.
- *
- * Returns TRUE if app->draws_attention has changed
- */
 static gboolean
-application_update_draws_attention (Application * app)
+im_application_list_root_action_idle (gpointer user_data)
 {
-  gchar **source_actions = NULL;
-  gchar **message_actions = NULL;
-  gchar **it;
-  gboolean was_drawing_attention = app->draws_attention;
-
-  app->draws_attention = FALSE;
-
-  source_actions = g_action_group_list_actions (G_ACTION_GROUP (app->source_actions));
-  for (it = source_actions; *it && !app->draws_attention; it++)
-    app->draws_attention = app_source_action_check_draw (app, *it);
+  ImApplicationList *list = user_data;
 
-  message_actions = g_action_group_list_actions (G_ACTION_GROUP (app->message_actions));
-  for (it = message_actions; *it && !app->draws_attention; it++)
-    app->draws_attention = app_message_action_check_draw (app, *it);
+  list->root_action_idle = 0;
+  im_application_list_flush_root_action (list);
 
-  g_strfreev (source_actions);
-  g_strfreev (message_actions);
+  return G_SOURCE_REMOVE;
+}
 
-  return was_drawing_attention != app->draws_attention;
+/* Marks the root action as outdated.  It is recomputed at most once per
+ * main loop iteration, after all pending events have been handled. */
+static void
+im_application_list_update_root_action (ImApplicationList *list)
+{
+  if (list->root_action_idle == 0)
+    list->root_action_idle = g_idle_add (im_application_list_root_action_idle, list);
 }
 
 static void
 im_application_list_source_removed_action (Application *app,
                                            const gchar *action_name)
 {
-  g_action_map_remove_action (G_ACTION_MAP(app->source_actions), action_name);
+  gboolean draws_attention;
+
+  application_clear_expiry (app, FALSE, action_name);
+  g_hash_table_remove (app->source_entries, action_name);
+
+  if (im_action_table_lookup (app->source_actions, action_name, &draws_attention))
+    {
+      application_update_counters (app, -1, -draws_attention, 0);
+      im_action_table_remove (app->source_actions, action_name);
+    }
+
   g_signal_emit (app->list, signals[SOURCE_REMOVED], 0, app->id, action_name);
 
-  application_update_draws_attention (app);
   im_application_list_update_root_action (app->list);
 }
 
@@ -363,26 +910,24 @@ static void
 im_application_list_source_removed (Application *app,
                                     const gchar *id)
 {
-  gchar *action_name;
-
-  action_name = escape_action_name (id);
+  gchar *tmp;
 
-  im_application_list_source_removed_action (app, action_name);
+  im_application_list_source_removed_action (app, escape_action_name (id, &tmp));
 
-  g_free (action_name);
+  g_free (tmp);
 }
 
 static void
-im_application_list_source_activated (GSimpleAction *action,
+im_application_list_source_activated (ImActionTable *table,
+                                      const gchar   *action_name,
                                       GVariant      *parameter,
                                       gpointer       user_data)
 {
   Application *app = user_data;
-  const gchar *action_name;
-  gchar *source_id;
+  const gchar *source_id;
+  gchar *tmp;
 
-  action_name = g_action_get_name (G_ACTION (action));
-  source_id = unescape_action_name (action_name);
+  source_id = unescape_action_name (action_name, &tmp);
 
   if (g_variant_get_boolean (parameter))
     {
@@ -401,46 +946,234 @@ im_application_list_source_activated (GSimpleAction *action,
 
   im_application_list_source_removed_action (app, action_name);
 
-  g_free (source_id);
+  g_free (tmp);
 }
 
 static void
 im_application_list_message_removed_action (Application *app,
                                             const gchar *action_name)
 {
-  g_action_map_remove_action (G_ACTION_MAP(app->message_actions), action_name);
+  gboolean draws_attention;
+
+  application_unindex_message (app, action_name);
+  application_clear_expiry (app, TRUE, action_name);
+
+  if (im_action_table_lookup (app->message_actions, action_name, &draws_attention))
+    {
+      application_update_counters (app, -1, 0, -draws_attention);
+      im_action_table_remove (app->message_actions, action_name);
+    }
+
   g_action_muxer_remove (app->message_sub_actions, action_name);
 
-  application_update_draws_attention (app);
   im_application_list_update_root_action (app->list);
 
   g_signal_emit (app->list, signals[MESSAGE_REMOVED], 0, app->id, action_name);
+
+  /* older messages might take its place in the menus */
+  application_fetch_more_messages (app);
 }
 
 static void
 im_application_list_message_removed (Application *app,
                                      const gchar *id)
 {
+  gchar *tmp;
+
+  im_application_list_message_removed_action (app, escape_action_name (id, &tmp));
+
+  g_free (tmp);
+}
+
+/* Handles TimeToLiveSet: @kind is "source" or "message", and @seconds
+ * is 0 to keep the item until it is removed */
+static void
+application_set_time_to_live (Application *app,
+                              const gchar *kind,
+                              const gchar *id,
+                              guint        seconds)
+{
+  gboolean is_message;
+  GHashTable **expiries;
+  const gchar *action_name;
+  gchar *tmp;
+
+  if (g_str_equal (kind, "message"))
+    is_message = TRUE;
+  else if (g_str_equal (kind, "source"))
+    is_message = FALSE;
+  else
+    return;
+
+  expiries = is_message ? &app->message_expiries : &app->source_expiries;
+  action_name = escape_action_name (id, &tmp);
+
+  if (seconds == 0)
+    {
+      application_clear_expiry (app, is_message, action_name);
+    }
+  else if (im_action_table_lookup (is_message ? app->message_actions : app->source_actions, action_name, NULL))
+    {
+      Expiry *expiry;
+
+      if (*expiries == NULL)
+        *expiries = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, expiry_free);
+
+      expiry = g_slice_new (Expiry);
+      expiry->app = app;
+      expiry->action_name = g_strdup (action_name);
+      expiry->is_message = is_message;
+      expiry->entry = im_timer_wheel_add (app->list->expiry_wheel,
+                                          g_get_monotonic_time () + (gint64) seconds * G_USEC_PER_SEC,
+                                          expiry);
+
+      /* replaces (and thereby unschedules) an earlier expiry */
+      g_hash_table_replace (*expiries, expiry->action_name, expiry);
+    }
+
+  g_free (tmp);
+}
+
+/* Removes an expired source or message like the user dismissing it */
+static void
+im_application_list_expire (gpointer data,
+                            gpointer user_data)
+{
+  Expiry *expiry = data;
+  Application *app = expiry->app;
+  gboolean is_message = expiry->is_message;
   gchar *action_name;
+  const gchar *id;
+  gchar *tmp;
+
+  /* the wheel freed the entry; removing the item frees @expiry */
+  expiry->entry = NULL;
+  action_name = g_strdup (expiry->action_name);
+
+  if (is_message)
+    im_application_list_message_removed_action (app, action_name);
+  else
+    im_application_list_source_removed_action (app, action_name);
 
-  action_name = escape_action_name (id);
+  id = unescape_action_name (action_name, &tmp);
 
-  im_application_list_message_removed_action(app, action_name);
+  if (app->proxy)
+    {
+      const gchar *ids[] = { id, NULL };
+      const gchar *none[] = { NULL };
+
+      indicator_messages_application_call_dismiss (app->proxy,
+                                                   is_message ? none : ids,
+                                                   is_message ? ids : none,
+                                                   app->cancellable, NULL, NULL);
+    }
 
+  g_free (tmp);
   g_free (action_name);
 }
 
+static gboolean
+im_application_list_report_evictions (gpointer user_data)
+{
+  ImApplicationList *list = user_data;
+
+  g_message ("dropped %u old messages to stay within the configured limits (%u since startup)",
+             list->n_evicted_unreported, list->n_evicted);
+
+  list->n_evicted_unreported = 0;
+  list->report_evictions_idle = 0;
+  return G_SOURCE_REMOVE;
+}
+
+/* Removes the oldest message in @order that doesn't draw attention, the
+ * same way as if its application had removed it.  Returns FALSE if all
+ * messages in @order draw attention. */
+static gboolean
+im_application_list_evict_oldest (ImApplicationList *list,
+                                  GSequence         *order)
+{
+  GSequenceIter *iter;
+
+  for (iter = g_sequence_get_begin_iter (order); !g_sequence_iter_is_end (iter); iter = g_sequence_iter_next (iter))
+    {
+      MessageEntry *entry = g_sequence_get (iter);
+
+      if (!entry->draws_attention)
+        {
+          gchar *action_name;
+
+          /* the entry is freed while the message is removed */
+          action_name = g_strdup (entry->action_name);
+          im_application_list_message_removed_action (entry->app, action_name);
+          g_free (action_name);
+
+          list->n_evicted++;
+          list->n_evicted_unreported++;
+          if (list->report_evictions_idle == 0)
+            list->report_evictions_idle = g_idle_add (im_application_list_report_evictions, list);
+
+          return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+/* Evicts messages until @app and the whole list are within their limits */
+static void
+application_enforce_message_limits (Application *app)
+{
+  ImApplicationList *list = app->list;
+
+  if (list->max_messages_per_app > 0)
+    {
+      while (g_hash_table_size (app->message_entries) > list->max_messages_per_app)
+        if (!im_application_list_evict_oldest (list, app->message_order))
+          break;
+    }
+
+  if (list->max_messages > 0)
+    {
+      while (g_sequence_get_length (list->message_order) > (gint) list->max_messages)
+        if (!im_application_list_evict_oldest (list, list->message_order))
+          break;
+    }
+}
+
+/* Whether the messages which @app lists after the ones it listed so far
+ * are worth fetching.  Messages that draw attention are always kept.
+ * Otherwise, lists are newest first, so once @app or the whole list
+ * have as many messages as they may show, later ones would only be
+ * evicted; below that, the menus decide how many they need. */
+static gboolean
+application_wants_more_messages (Application *app)
+{
+  ImApplicationList *list = app->list;
+  guint n_messages = g_hash_table_size (app->message_entries);
+
+  if (app->messages_attention_after)
+    return TRUE;
+
+  if (list->max_messages_per_app > 0 && n_messages >= list->max_messages_per_app)
+    return FALSE;
+
+  if (list->max_messages > 0 && (guint) g_sequence_get_length (list->message_order) >= list->max_messages)
+    return FALSE;
+
+  return n_messages < list->messages_wanted;
+}
+
 static void
-im_application_list_message_activated (GSimpleAction *action,
+im_application_list_message_activated (ImActionTable *table,
+                                       const gchar   *action_name,
                                        GVariant      *parameter,
                                        gpointer       user_data)
 {
   Application *app = user_data;
-  const gchar *action_name;
-  gchar *message_id;
+  const gchar *message_id;
+  gchar *tmp;
 
-  action_name = g_action_get_name (G_ACTION (action));
-  message_id = unescape_action_name (action_name);
+  message_id = unescape_action_name (action_name, &tmp);
 
   if (g_variant_get_boolean (parameter))
     {
@@ -461,7 +1194,7 @@ im_application_list_message_activated (GSimpleAction *action,
 
   im_application_list_message_removed_action (app, action_name);
 
-  g_free (message_id);
+  g_free (tmp);
 }
 
 static void
@@ -471,11 +1204,12 @@ im_application_list_sub_message_activated (GSimpleAction *action,
 {
   Application *app = user_data;
   const gchar *message_id;
-  gchar *action_id;
+  const gchar *action_id;
+  gchar *tmp;
   GVariantBuilder builder;
 
   message_id = g_object_get_data (G_OBJECT (action), "message");
-  action_id = unescape_action_name (g_action_get_name (G_ACTION (action)));
+  action_id = unescape_action_name (g_action_get_name (G_ACTION (action)), &tmp);
 
   g_variant_builder_init (&builder, G_VARIANT_TYPE ("av"));
   if (parameter)
@@ -490,7 +1224,19 @@ im_application_list_sub_message_activated (GSimpleAction *action,
 
   im_application_list_message_removed (app, message_id);
 
-  g_free (action_id);
+  g_free (tmp);
+}
+
+/* Phone menus only show a window of the newest messages; this asks them
+ * to show another page */
+static void
+im_application_list_show_more_messages (GSimpleAction *action,
+                                        GVariant      *parameter,
+                                        gpointer       user_data)
+{
+  ImApplicationList *list = user_data;
+
+  g_signal_emit (list, signals[SHOW_MORE_MESSAGES], 0);
 }
 
 static void
@@ -502,51 +1248,40 @@ im_application_list_remove_all (GSimpleAction *action,
   GHashTableIter iter;
   Application *app;
 
+  /* menus drop all of their items in one go when receiving this, so
+   * no per-item signals are emitted below */
   g_signal_emit (list, signals[REMOVE_ALL], 0);
 
   g_hash_table_iter_init (&iter, list->applications);
   while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &app))
     {
-      gchar **source_actions;
-      gchar **message_actions;
-      gchar **it;
-
-      app->draws_attention = FALSE;
-
-      source_actions = g_action_group_list_actions (G_ACTION_GROUP (app->source_actions));
-      for (it = source_actions; *it; it++)
-        im_application_list_source_removed_action (app, *it);
-
-      message_actions = g_action_group_list_actions (G_ACTION_GROUP (app->message_actions));
-      for (it = message_actions; *it; it++)
-        im_application_list_message_removed_action (app, *it);
+      if (app->n_items == 0)
+        continue;
 
       if (app->proxy != NULL) /* If it is remote, we tell the app we've cleared */
         {
-          guint i;
-          gchar **unescaped_source_actions;
-          gchar **unescaped_message_actions;
-
-          /* Unescape action names */
-          unescaped_source_actions = g_new0 (gchar *, g_strv_length (source_actions) + 1);
-          for (i = 0; source_actions[i]; i++)
-            unescaped_source_actions[i] = unescape_action_name (source_actions[i]);
-
-          unescaped_message_actions = g_new0 (gchar *, g_strv_length (message_actions) + 1);
-          for (i = 0; message_actions[i]; i++)
-            unescaped_message_actions[i] = unescape_action_name (message_actions[i]);
-
-          indicator_messages_application_call_dismiss (app->proxy, 
-                                                       (const gchar * const *) unescaped_source_actions,
-                                                       (const gchar * const *) unescaped_message_actions,
+          gchar **sources;
+          gchar **messages;
+
+          sources = action_group_list_ids (G_ACTION_GROUP (app->source_actions));
+          messages = action_group_list_ids (G_ACTION_GROUP (app->message_actions));
+
+          indicator_messages_application_call_dismiss (app->proxy,
+                                                       (const gchar * const *) sources,
+                                                       (const gchar * const *) messages,
                                                        app->cancellable, NULL, NULL);
 
-          g_strfreev (unescaped_source_actions);
-          g_strfreev (unescaped_message_actions);
+          g_strfreev (sources);
+          g_strfreev (messages);
         }
 
-      g_strfreev (source_actions);
-      g_strfreev (message_actions);
+      application_reset_actions (app);
+
+      /* Messages which were never listed weren't shown either, so they
+       * stay with the application instead of replacing the cleared
+       * ones.  It lists them again when it registers the next time. */
+      g_clear_pointer (&app->messages_cursor, g_free);
+      app->messages_attention_after = FALSE;
     }
 
   im_application_list_update_root_action (list);
@@ -556,22 +1291,73 @@ static void
 im_application_list_dispose (GObject *object)
 {
   ImApplicationList *list = IM_APPLICATION_LIST (object);
+  guint i;
+
+  if (list->root_action_idle)
+    {
+      g_source_remove (list->root_action_idle);
+      list->root_action_idle = 0;
+    }
+
+  if (list->report_evictions_idle)
+    {
+      g_source_remove (list->report_evictions_idle);
+      list->report_evictions_idle = 0;
+    }
+
+  if (list->settings)
+    {
+      g_signal_handlers_disconnect_by_data (list->settings, list);
+      g_clear_object (&list->settings);
+    }
+
+  list->root_state = NULL;
+  for (i = 0; i < N_STATUSES; i++)
+    {
+      g_clear_pointer (&list->root_states[i][FALSE][FALSE], g_variant_unref);
+      g_clear_pointer (&list->root_states[i][FALSE][TRUE], g_variant_unref);
+      g_clear_pointer (&list->root_states[i][TRUE][FALSE], g_variant_unref);
+      g_clear_pointer (&list->root_states[i][TRUE][TRUE], g_variant_unref);
+    }
 
   g_clear_object (&list->statusaction);
   g_clear_object (&list->globalactions);
   g_clear_pointer (&list->app_status, g_hash_table_unref);
 
+  /* applications remove themselves from remotes when they are freed */
   g_clear_pointer (&list->applications, g_hash_table_unref);
   g_clear_object (&list->muxer);
 
+  if (list->connection)
+    {
+      g_dbus_connection_signal_unsubscribe (list->connection, list->app_signals_id);
+      g_clear_object (&list->connection);
+    }
+  g_clear_pointer (&list->remotes, g_hash_table_unref);
+  g_clear_pointer (&list->remote_watches, g_hash_table_unref);
+
   g_clear_object (&list->as);
 
+  if (list->app_infos)
+    {
+      g_signal_handlers_disconnect_by_data (list->app_infos, list);
+      g_clear_object (&list->app_infos);
+    }
+
   G_OBJECT_CLASS (im_application_list_parent_class)->dispose (object);
 }
 
 static void
 im_application_list_finalize (GObject *object)
 {
+  ImApplicationList *list = IM_APPLICATION_LIST (object);
+
+  /* applications release their icons and messages when they are
+   * freed in dispose */
+  g_clear_object (&list->icon_store);
+  g_sequence_free (list->message_order);
+  im_timer_wheel_free (list->expiry_wheel);
+
   G_OBJECT_CLASS (im_application_list_parent_class)->finalize (object);
 }
 
@@ -583,6 +1369,8 @@ im_application_list_class_init (ImApplicationListClass *klass)
   object_class->dispose = im_application_list_dispose;
   object_class->finalize = im_application_list_finalize;
 
+  /* Strings are passed without being copied for each emission.  They
+   * are only valid while the handlers run. */
   signals[SOURCE_ADDED] = g_signal_new ("source-added",
                                         IM_TYPE_APPLICATION_LIST,
                                         G_SIGNAL_RUN_FIRST,
@@ -591,9 +1379,9 @@ im_application_list_class_init (ImApplicationListClass *klass)
                                         g_cclosure_marshal_generic,
                                         G_TYPE_NONE,
                                         5,
-                                        G_TYPE_STRING,
-                                        G_TYPE_STRING,
-                                        G_TYPE_STRING,
+                                        G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE,
+                                        G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE,
+                                        G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE,
                                         G_TYPE_VARIANT,
                                         G_TYPE_BOOLEAN);
 
@@ -605,9 +1393,9 @@ im_application_list_class_init (ImApplicationListClass *klass)
                                           g_cclosure_marshal_generic,
                                           G_TYPE_NONE,
                                           5,
-                                          G_TYPE_STRING,
-                                          G_TYPE_STRING,
-                                          G_TYPE_STRING,
+                                          G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE,
+                                          G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE,
+                                          G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE,
                                           G_TYPE_VARIANT,
                                           G_TYPE_BOOLEAN);
 
@@ -619,8 +1407,8 @@ im_application_list_class_init (ImApplicationListClass *klass)
                                           g_cclosure_marshal_generic,
                                           G_TYPE_NONE,
                                           2,
-                                          G_TYPE_STRING,
-                                          G_TYPE_STRING);
+                                          G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE,
+                                          G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE);
 
   signals[MESSAGE_ADDED] = g_signal_new ("message-added",
                                          IM_TYPE_APPLICATION_LIST,
@@ -630,13 +1418,13 @@ im_application_list_class_init (ImApplicationListClass *klass)
                                          g_cclosure_marshal_generic,
                                          G_TYPE_NONE,
                                          10,
-                                         G_TYPE_STRING,
-                                         G_TYPE_ICON,
-                                         G_TYPE_STRING,
+                                         G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE,
                                          G_TYPE_VARIANT,
-                                         G_TYPE_STRING,
-                                         G_TYPE_STRING,
-                                         G_TYPE_STRING,
+                                         G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE,
+                                         G_TYPE_VARIANT,
+                                         G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE,
+                                         G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE,
+                                         G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE,
                                          G_TYPE_VARIANT,
                                          G_TYPE_INT64,
                                          G_TYPE_BOOLEAN);
@@ -649,8 +1437,8 @@ im_application_list_class_init (ImApplicationListClass *klass)
                                            g_cclosure_marshal_generic,
                                            G_TYPE_NONE,
                                            2,
-                                           G_TYPE_STRING,
-                                           G_TYPE_STRING);
+                                           G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE,
+                                           G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE);
 
   signals[APP_ADDED] = g_signal_new ("app-added",
                                      IM_TYPE_APPLICATION_LIST,
@@ -660,7 +1448,7 @@ im_application_list_class_init (ImApplicationListClass *klass)
                                      g_cclosure_marshal_generic,
                                      G_TYPE_NONE,
                                      2,
-                                     G_TYPE_STRING,
+                                     G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE,
                                      G_TYPE_DESKTOP_APP_INFO);
 
   signals[APP_STOPPED] = g_signal_new ("app-stopped",
@@ -671,7 +1459,7 @@ im_application_list_class_init (ImApplicationListClass *klass)
                                        g_cclosure_marshal_VOID__STRING,
                                        G_TYPE_NONE,
                                        1,
-                                       G_TYPE_STRING);
+                                       G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE);
 
   signals[REMOVE_ALL] = g_signal_new ("remove-all",
                                       IM_TYPE_APPLICATION_LIST,
@@ -682,6 +1470,15 @@ im_application_list_class_init (ImApplicationListClass *klass)
                                       G_TYPE_NONE,
                                       0);
 
+  signals[SHOW_MORE_MESSAGES] = g_signal_new ("show-more-messages",
+                                              IM_TYPE_APPLICATION_LIST,
+                                              G_SIGNAL_RUN_FIRST,
+                                              0,
+                                              NULL, NULL,
+                                              g_cclosure_marshal_VOID__VOID,
+                                              G_TYPE_NONE,
+                                              0);
+
   signals[STATUS_SET] = g_signal_new ("status-set",
                                       IM_TYPE_APPLICATION_LIST,
                                       G_SIGNAL_RUN_FIRST,
@@ -690,18 +1487,70 @@ im_application_list_class_init (ImApplicationListClass *klass)
                                       g_cclosure_marshal_generic,
                                       G_TYPE_NONE,
                                       1,
-                                      G_TYPE_STRING);
+                                      G_TYPE_STRING | G_SIGNAL_TYPE_STATIC_SCOPE);
+}
+
+/* Picks up the new desktop files of all applications after the app
+ * info database changed and drops what was derived from the old ones */
+static void
+im_application_list_app_infos_changed (ImAppInfoCache *app_infos,
+                                       gpointer        user_data)
+{
+  ImApplicationList *list = user_data;
+  GHashTableIter iter;
+  Application *app;
+
+  g_hash_table_iter_init (&iter, list->applications);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &app))
+    {
+      GDesktopAppInfo *info;
+
+      /* keep the old one around if the application was uninstalled */
+      info = im_app_info_cache_lookup (app_infos, g_app_info_get_id (G_APP_INFO (app->info)));
+      if (info)
+        {
+          g_object_unref (app->info);
+          app->info = info;
+        }
+
+      g_clear_pointer (&app->serialized_app_icon, g_variant_unref);
+      app->app_icon_valid = FALSE;
+    }
+}
+
+static void
+im_application_list_message_limits_changed (GSettings   *settings,
+                                            const gchar *key,
+                                            gpointer     user_data)
+{
+  ImApplicationList *list = user_data;
+  GHashTableIter iter;
+  Application *app;
+
+  list->max_messages = g_settings_get_uint (settings, "max-messages");
+  list->max_messages_per_app = g_settings_get_uint (settings, "max-messages-per-application");
+
+  g_hash_table_iter_init (&iter, list->applications);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &app))
+    {
+      application_enforce_message_limits (app);
+      application_fetch_more_messages (app);
+    }
 }
 
 static void
 im_application_list_init (ImApplicationList *list)
 {
   const GActionEntry action_entries[] = {
-    { "remove-all", im_application_list_remove_all }
+    { "remove-all", im_application_list_remove_all },
+    { "show-more-messages", im_application_list_show_more_messages }
   };
+  guint i;
 
   list->applications = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, application_free);
   list->app_status = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  list->remotes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  list->remote_watches = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, unwatch_name);
 
   list->globalactions = g_simple_action_group_new ();
   {
@@ -718,8 +1567,31 @@ im_application_list_init (ImApplicationList *list)
   g_action_muxer_insert (list->muxer, NULL, G_ACTION_GROUP (list->globalactions));
 
   list->as = im_accounts_service_ref_default();
+  list->app_infos = im_app_info_cache_ref_default ();
+  list->icon_store = im_icon_store_ref_default ();
+
+  list->message_order = g_sequence_new (NULL);
+  list->expiry_wheel = im_timer_wheel_new (im_application_list_expire, list);
+  list->settings = g_settings_new ("org.ayatana.indicator.messages");
+  g_signal_connect (list->settings, "changed::max-messages",
+                    G_CALLBACK (im_application_list_message_limits_changed), list);
+  g_signal_connect (list->settings, "changed::max-messages-per-application",
+                    G_CALLBACK (im_application_list_message_limits_changed), list);
+  im_application_list_message_limits_changed (list->settings, NULL, list);
+  g_signal_connect (list->app_infos, "changed", G_CALLBACK (im_application_list_app_infos_changed), list);
+
+  for (i = 0; i < N_STATUSES; i++)
+    {
+      list->root_states[i][FALSE][FALSE] = im_application_list_build_root_state (status_ids[i], FALSE, FALSE);
+      list->root_states[i][FALSE][TRUE] = im_application_list_build_root_state (status_ids[i], FALSE, TRUE);
+      list->root_states[i][TRUE][FALSE] = im_application_list_build_root_state (status_ids[i], TRUE, FALSE);
+      list->root_states[i][TRUE][TRUE] = im_application_list_build_root_state (status_ids[i], TRUE, TRUE);
+    }
+  list->published_attention = -1;
 
-  im_application_list_update_root_action (list);
+  /* publish the initial state right away, it is exported before the
+   * main loop gets to run the first time */
+  im_application_list_flush_root_action (list);
 }
 
 ImApplicationList *
@@ -728,24 +1600,32 @@ im_application_list_new (void)
   return g_object_new (IM_TYPE_APPLICATION_LIST, NULL);
 }
 
-static gchar *
-im_application_list_canonical_id (const gchar *id)
+/* Writes the canonical form of @id (without ".desktop" and with dots
+ * replaced by underscores) to @dest, which must hold at least
+ * strlen (@id) + 1 bytes. */
+static void
+im_application_list_canonicalize_id (const gchar *id,
+                                     gchar       *dest)
 {
-  gchar *str;
-  gchar *p;
-  int len;
+  gsize len;
+  gsize i;
 
   len = strlen (id);
   if (g_str_has_suffix (id, ".desktop"))
     len -= 8;
 
-  str = g_strndup (id, len);
+  for (i = 0; i < len; i++)
+    dest[i] = id[i] == '.' ? '_' : id[i];
+  dest[len] = '\0';
+}
 
-  for (p = str; *p; p++)
-    {
-      if (*p == '.')
-        *p = '_';
-    }
+static gchar *
+im_application_list_canonical_id (const gchar *id)
+{
+  gchar *str;
+
+  str = g_malloc (strlen (id) + 1);
+  im_application_list_canonicalize_id (id, str);
 
   return str;
 }
@@ -754,13 +1634,21 @@ static Application *
 im_application_list_lookup (ImApplicationList *list,
                             const gchar       *desktop_id)
 {
-  gchar *id;
+  gchar buf[128];
+  gchar *id = buf;
   Application *app;
 
-  id = im_application_list_canonical_id (desktop_id);
+  /* this is called for every request from an application, avoid
+   * allocating for the common case of reasonably short ids */
+  if (strlen (desktop_id) >= sizeof buf)
+    id = g_malloc (strlen (desktop_id) + 1);
+
+  im_application_list_canonicalize_id (desktop_id, id);
   app = g_hash_table_lookup (list->applications, id);
 
-  g_free (id);
+  if (id != buf)
+    g_free (id);
+
   return app;
 }
 
@@ -806,7 +1694,7 @@ im_application_list_add (ImApplicationList  *list,
   if (im_application_list_lookup (list, desktop_id))
     return TRUE;
 
-  info = g_desktop_app_info_new (desktop_id);
+  info = im_app_info_cache_lookup (list->app_infos, desktop_id);
   if (!info)
     {
       g_warning ("an application with id '%s' is not installed", desktop_id);
@@ -827,10 +1715,13 @@ im_application_list_add (ImApplicationList  *list,
   app->id = im_application_list_canonical_id (id);
   app->list = list;
   app->muxer = g_action_muxer_new ();
-  app->source_actions = g_simple_action_group_new ();
-  app->message_actions = g_simple_action_group_new ();
+  app->source_actions = im_action_table_new (G_VARIANT_TYPE_BOOLEAN, im_application_list_source_activated, app);
+  app->message_actions = im_action_table_new (G_VARIANT_TYPE_BOOLEAN, im_application_list_message_activated, app);
   app->message_sub_actions = g_action_muxer_new ();
-  app->draws_attention = FALSE;
+  app->message_entries = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, message_entry_free);
+  app->message_order = g_sequence_new (NULL);
+  app->source_entries = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, source_entry_free);
+  app->source_order = g_sequence_new (NULL);
   app->shortcuts = shortcuts;
 
   actions = g_simple_action_group_new ();
@@ -883,134 +1774,474 @@ im_application_list_remove (ImApplicationList *list,
   app = im_application_list_lookup (list, id);
   if (app)
     {
+      gchar *app_id;
+
       if (app->proxy || app->cancellable)
         g_signal_emit (app->list, signals[APP_STOPPED], 0, app->id);
 
-      g_hash_table_remove (list->applications, id);
-      g_action_muxer_remove (list->muxer, id);
+      application_clear_counters (app);
+
+      app_id = g_strdup (app->id);
+      g_hash_table_remove (list->applications, app_id);
+      g_action_muxer_remove (list->muxer, app_id);
+      g_free (app_id);
 
       im_application_list_update_root_action (list);
     }
 }
 
 static void
-im_application_list_source_added (Application *app,
-                                  guint        position,
-                                  GVariant    *source)
+app_icon_free (gpointer data)
 {
-  const gchar *id;
-  const gchar *label;
-  GVariant *maybe_serialized_icon;
-  guint32 count;
-  gint64 time;
-  const gchar *string;
-  gboolean draws_attention;
-  gboolean visible;
-  GVariant *serialized_icon = NULL;
-  GVariant *state;
-  GSimpleAction *action;
-  gchar *action_name;
+  AppIcon *icon = data;
 
-  g_variant_get (source, "(&s&s@avux&sb)",
-                 &id, &label, &maybe_serialized_icon, &count, &time, &string, &draws_attention);
+  g_variant_unref (icon->shared);
+  g_slice_free (AppIcon, icon);
+}
 
-  if (g_variant_n_children (maybe_serialized_icon) == 1)
-    g_variant_get_child (maybe_serialized_icon, 0, "v", &serialized_icon);
+typedef struct
+{
+  Application *app;
+  gchar **hashes;
+} ReleasedIcons;
 
-  visible = count > 0 || time != 0 || (string != NULL && string[0] != '\0');
+static void
+im_application_list_icons_released (GObject      *source_object,
+                                    GAsyncResult *result,
+                                    gpointer      user_data)
+{
+  ReleasedIcons *released = user_data;
+  Application *app = released->app;
+  GError *error = NULL;
+  gboolean released_ok;
+  gchar **it;
 
-  state = g_variant_new ("(uxsb)", count, time, string, draws_attention);
-  action_name = escape_action_name (id);
-  action = g_simple_action_new_stateful (action_name, G_VARIANT_TYPE_BOOLEAN, state);
-  g_signal_connect (action, "activate", G_CALLBACK (im_application_list_source_activated), app);
+  released_ok = indicator_messages_application_call_release_icons_finish (INDICATOR_MESSAGES_APPLICATION (source_object),
+                                                                          result, &error);
+  if (!released_ok)
+    {
+      /* @app might be gone already */
+      if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+          g_error_free (error);
+          g_strfreev (released->hashes);
+          g_slice_free (ReleasedIcons, released);
+          return;
+        }
 
-  g_action_map_add_action (G_ACTION_MAP(app->source_actions), G_ACTION (action));
+      /* The application may still refer to the icons, so they are
+       * kept.  They are not released again until a source or message
+       * uses them and goes away once more, or until the application
+       * registers again or goes away.  Applications that don't know
+       * ReleaseIcons keep all of their icons that way. */
+      if (!g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD))
+        g_warning ("could not release the icons of '%s': %s", app->id, error->message);
+      g_clear_error (&error);
+    }
 
-  g_signal_emit (app->list, signals[SOURCE_ADDED], 0, app->id, action_name, label, serialized_icon, visible);
+  for (it = released->hashes; *it; it++)
+    {
+      AppIcon *icon;
 
-  if (visible && draws_attention && app->draws_attention == FALSE)
-    app->draws_attention = TRUE;
+      icon = app->icons ? g_hash_table_lookup (app->icons, *it) : NULL;
+      if (icon == NULL || !icon->releasing)
+        continue;
 
-  im_application_list_update_root_action (app->list);
+      icon->releasing = FALSE;
 
-  g_free (action_name);
-  g_object_unref (action);
-  if (serialized_icon)
-    g_variant_unref (serialized_icon);
-  g_variant_unref (maybe_serialized_icon);
+      /* Sources and messages which the application sent before it
+       * forgot about the icon may have started using it again.  It
+       * uploads the icon again before using it the next time. */
+      if (icon->users == 0 && released_ok)
+        {
+          im_icon_store_release (app->list->icon_store, *it);
+          g_hash_table_remove (app->icons, *it);
+        }
+    }
+
+  g_strfreev (released->hashes);
+  g_slice_free (ReleasedIcons, released);
 }
 
-static void
-im_application_list_source_changed (Application *app,
-                                    GVariant    *source)
+static gboolean
+application_release_icons_idle (gpointer user_data)
 {
-  const gchar *id;
-  const gchar *label;
-  GVariant *maybe_serialized_icon;
-  guint32 count;
-  gint64 time;
-  const gchar *string;
-  gboolean draws_attention;
-  GVariant *serialized_icon = NULL;
-  gboolean visible;
-  gchar *action_name;
+  Application *app = user_data;
+  ReleasedIcons *released;
+  GPtrArray *hashes;
+  guint i;
 
-  g_variant_get (source, "(&s&s@avux&sb)",
-                 &id, &label, &maybe_serialized_icon, &count, &time, &string, &draws_attention);
+  app->release_icons_idle = 0;
+
+  /* skip icons that were used again in the meantime */
+  hashes = g_ptr_array_new ();
+  for (i = 0; i < app->released_icons->len; i++)
+    {
+      gchar *hash = g_ptr_array_index (app->released_icons, i);
+      AppIcon *icon;
 
-  if (g_variant_n_children (maybe_serialized_icon) == 1)
-    g_variant_get_child (maybe_serialized_icon, 0, "v", &serialized_icon);
+      icon = g_hash_table_lookup (app->icons, hash);
+      if (icon->users == 0)
+        {
+          g_ptr_array_add (hashes, hash);
+        }
+      else
+        {
+          icon->releasing = FALSE;
+          g_free (hash);
+        }
+    }
 
-  action_name = escape_action_name (id);
+  /* the hashes have been moved into @hashes or freed */
+  g_ptr_array_set_free_func (app->released_icons, NULL);
+  g_ptr_array_set_size (app->released_icons, 0);
+  g_ptr_array_set_free_func (app->released_icons, g_free);
 
-  g_action_group_change_action_state (G_ACTION_GROUP (app->source_actions), action_name,
-                                      g_variant_new ("(uxsb)", count, time, string, draws_attention));
+  if (hashes->len == 0)
+    {
+      g_ptr_array_unref (hashes);
+      return G_SOURCE_REMOVE;
+    }
 
-  visible = count > 0 || time != 0 || (string != NULL && string[0] != '\0');
+  g_ptr_array_add (hashes, NULL);
 
-  g_signal_emit (app->list, signals[SOURCE_CHANGED], 0, app->id, action_name, label, serialized_icon, visible);
+  released = g_slice_new (ReleasedIcons);
+  released->app = app;
+  released->hashes = (gchar **) g_ptr_array_free (hashes, FALSE);
 
-  application_update_draws_attention (app);
-  im_application_list_update_root_action (app->list);
+  indicator_messages_application_call_release_icons (app->proxy,
+                                                     (const gchar * const *) released->hashes,
+                                                     app->cancellable,
+                                                     im_application_list_icons_released, released);
 
-  if (serialized_icon)
-    g_variant_unref (serialized_icon);
-  g_variant_unref (maybe_serialized_icon);
-  g_free (action_name);
+  return G_SOURCE_REMOVE;
 }
 
+/* Drops a use of the uploaded icon @hash, if any.  Icons which are not
+ * used anymore are handed back to the application, so that neither side
+ * keeps them around for the rest of the session. */
 static void
-im_application_list_sources_listed (GObject      *source_object,
-                                    GAsyncResult *result,
-                                    gpointer      user_data)
+application_release_icon (Application *app,
+                          const gchar *hash)
 {
-  Application *app = user_data;
-  GVariant *sources;
-  GError *error = NULL;
+  AppIcon *icon;
 
-  if (indicator_messages_application_call_list_sources_finish (app->proxy, &sources, result, &error))
-    {
-      GVariantIter iter;
-      GVariant *source;
-      guint i = 0;
+  if (hash == NULL || app->icons == NULL)
+    return;
 
-      g_variant_iter_init (&iter, sources);
-      while ((source = g_variant_iter_next_value (&iter)))
-        {
-          im_application_list_source_added (app, i++, source);
-          g_variant_unref (source);
-        }
+  icon = g_hash_table_lookup (app->icons, hash);
+  if (icon == NULL)
+    return;
 
-      g_variant_unref (sources);
-    }
-  else
-    {
-      g_warning ("could not fetch the list of sources: %s", error->message);
-      g_error_free (error);
-    }
-}
+  if (icon->users > 0)
+    icon->users--;
 
-static GIcon *
+  if (icon->users > 0 || icon->releasing)
+    return;
+
+  icon->releasing = TRUE;
+
+  if (app->released_icons == NULL)
+    app->released_icons = g_ptr_array_new_with_free_func (g_free);
+  g_ptr_array_add (app->released_icons, g_strdup (hash));
+
+  if (app->release_icons_idle == 0)
+    app->release_icons_idle = g_idle_add (application_release_icons_idle, app);
+}
+
+/* Stores an icon uploaded by @app, unless it was uploaded before */
+static void
+application_add_icon (Application *app,
+                      const gchar *hash,
+                      GVariant    *serialized_icon)
+{
+  AppIcon *icon;
+  GVariant *shared;
+
+  if (app->icons == NULL)
+    app->icons = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, app_icon_free);
+  else if (g_hash_table_contains (app->icons, hash))
+    return;
+
+  shared = im_icon_store_insert (app->list->icon_store, hash, serialized_icon);
+  if (shared == NULL)
+    {
+      g_warning ("application '%s' uploaded an icon that doesn't match its hash '%s'", app->id, hash);
+      return;
+    }
+
+  icon = g_slice_new (AppIcon);
+  icon->shared = shared;
+  icon->users = 1;
+  icon->releasing = FALSE;
+  g_hash_table_insert (app->icons, g_strdup (hash), icon);
+
+  /* uploads are followed by the source or message which uses the icon;
+   * the upload's own use makes sure that unused icons are released */
+  application_release_icon (app, hash);
+}
+
+/* Returns the icon in the fake-maybe @maybe_serialized_icon of a source
+ * or message.  That is either a serialized icon, or an ("icon-ref",
+ * <hash>) pair that refers to an icon uploaded with IconAdded, in which
+ * case the shared copy is returned and @icon_hash is set to a use of
+ * that icon, which must be dropped with application_release_icon(). */
+static GVariant *
+application_resolve_icon (Application  *app,
+                          GVariant     *maybe_serialized_icon,
+                          gchar       **icon_hash)
+{
+  GVariant *serialized_icon;
+  const gchar *tag;
+  GVariant *value;
+
+  *icon_hash = NULL;
+
+  if (g_variant_n_children (maybe_serialized_icon) != 1)
+    return NULL;
+
+  g_variant_get_child (maybe_serialized_icon, 0, "v", &serialized_icon);
+
+  if (!g_variant_is_of_type (serialized_icon, G_VARIANT_TYPE ("(sv)")))
+    return serialized_icon;
+
+  g_variant_get (serialized_icon, "(&sv)", &tag, &value);
+  if (g_str_equal (tag, "icon-ref"))
+    {
+      AppIcon *icon = NULL;
+
+      if (app->icons && g_variant_is_of_type (value, G_VARIANT_TYPE_STRING))
+        icon = g_hash_table_lookup (app->icons, g_variant_get_string (value, NULL));
+
+      g_variant_unref (serialized_icon);
+      serialized_icon = NULL;
+
+      if (icon)
+        {
+          icon->users++;
+          *icon_hash = g_variant_dup_string (value, NULL);
+          serialized_icon = g_variant_ref (icon->shared);
+        }
+    }
+
+  g_variant_unref (value);
+
+  return serialized_icon;
+}
+
+static void
+im_application_list_source_added (Application *app,
+                                  guint        position,
+                                  GVariant    *source)
+{
+  const gchar *id;
+  const gchar *label;
+  GVariant *maybe_serialized_icon;
+  guint32 count;
+  gint64 time;
+  const gchar *string;
+  gboolean draws_attention;
+  gboolean visible;
+  GVariant *serialized_icon;
+  gchar *icon_hash;
+  gboolean was_drawing_attention;
+  const gchar *action_name;
+  gchar *tmp;
+
+  g_variant_get (source, "(&s&s@avux&sb)",
+                 &id, &label, &maybe_serialized_icon, &count, &time, &string, &draws_attention);
+
+  serialized_icon = application_resolve_icon (app, maybe_serialized_icon, &icon_hash);
+
+  visible = count > 0 || time != 0 || (string != NULL && string[0] != '\0');
+
+  action_name = escape_action_name (id, &tmp);
+
+  /* adding an action with an existing name replaces the old one, along
+   * with its expiry */
+  if (im_action_table_lookup (app->source_actions, action_name, &was_drawing_attention))
+    {
+      application_update_counters (app, -1, -was_drawing_attention, 0);
+      application_clear_expiry (app, FALSE, action_name);
+    }
+
+  im_action_table_insert (app->source_actions, action_name,
+                          g_variant_new ("(uxsb)", count, time, string, draws_attention),
+                          visible && draws_attention);
+  application_update_counters (app, 1, visible && draws_attention, 0);
+  application_store_source (app, action_name, label, serialized_icon, icon_hash, visible);
+
+  g_signal_emit (app->list, signals[SOURCE_ADDED], 0, app->id, action_name, label, serialized_icon, visible);
+
+  im_application_list_update_root_action (app->list);
+
+  g_free (tmp);
+  if (serialized_icon)
+    g_variant_unref (serialized_icon);
+  g_variant_unref (maybe_serialized_icon);
+}
+
+static void
+im_application_list_source_changed (Application *app,
+                                    GVariant    *source)
+{
+  const gchar *id;
+  const gchar *label;
+  GVariant *maybe_serialized_icon;
+  guint32 count;
+  gint64 time;
+  const gchar *string;
+  gboolean draws_attention;
+  GVariant *serialized_icon;
+  gchar *icon_hash;
+  gboolean visible;
+  gboolean was_drawing_attention;
+  const gchar *action_name;
+  gchar *tmp;
+
+  g_variant_get (source, "(&s&s@avux&sb)",
+                 &id, &label, &maybe_serialized_icon, &count, &time, &string, &draws_attention);
+
+  serialized_icon = application_resolve_icon (app, maybe_serialized_icon, &icon_hash);
+
+  action_name = escape_action_name (id, &tmp);
+
+  visible = count > 0 || time != 0 || (string != NULL && string[0] != '\0');
+
+  if (im_action_table_lookup (app->source_actions, action_name, &was_drawing_attention))
+    {
+      im_action_table_set_state (app->source_actions, action_name,
+                                 g_variant_new ("(uxsb)", count, time, string, draws_attention),
+                                 visible && draws_attention);
+      application_update_counters (app, 0, (visible && draws_attention) - was_drawing_attention, 0);
+      application_store_source (app, action_name, label, serialized_icon, icon_hash, visible);
+    }
+  else
+    {
+      application_release_icon (app, icon_hash);
+      g_free (icon_hash);
+    }
+
+  g_signal_emit (app->list, signals[SOURCE_CHANGED], 0, app->id, action_name, label, serialized_icon, visible);
+
+  im_application_list_update_root_action (app->list);
+
+  if (serialized_icon)
+    g_variant_unref (serialized_icon);
+  g_variant_unref (maybe_serialized_icon);
+  g_free (tmp);
+}
+
+/* Merges a partial update into the state of an existing source.  Label
+ * and icon are unchanged and the application sends SourceChanged when
+ * the source appears or disappears, so the menus need not be told: they
+ * pick up the new state through the source's action. */
+static void
+im_application_list_source_updated (Application *app,
+                                    const gchar *id,
+                                    GVariant    *changes)
+{
+  const gchar *action_name;
+  gchar *tmp;
+  GVariant *state;
+  guint32 count;
+  gint64 time;
+  const gchar *string;
+  gboolean draws_attention;
+  gboolean visible;
+  gboolean was_drawing_attention;
+
+  action_name = escape_action_name (id, &tmp);
+
+  if (!im_action_table_lookup (app->source_actions, action_name, &was_drawing_attention))
+    {
+      g_free (tmp);
+      return;
+    }
+
+  state = g_action_group_get_action_state (G_ACTION_GROUP (app->source_actions), action_name);
+  g_variant_get (state, "(ux&sb)", &count, &time, &string, &draws_attention);
+
+  g_variant_lookup (changes, "count", "u", &count);
+  g_variant_lookup (changes, "time", "x", &time);
+  g_variant_lookup (changes, "string", "&s", &string);
+  g_variant_lookup (changes, "draws-attention", "b", &draws_attention);
+
+  visible = count > 0 || time != 0 || string[0] != '\0';
+
+  im_action_table_set_state (app->source_actions, action_name,
+                             g_variant_new ("(uxsb)", count, time, string, draws_attention),
+                             visible && draws_attention);
+  application_update_counters (app, 0, (visible && draws_attention) - was_drawing_attention, 0);
+
+  im_application_list_update_root_action (app->list);
+
+  g_variant_unref (state);
+  g_free (tmp);
+}
+
+/* Handles a failed ListSources or ListMessages call */
+static void
+im_application_list_list_failed (Application  *app,
+                                 const gchar  *what,
+                                 const GError *error)
+{
+  /* @app might be gone already */
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    return;
+
+  /* the application vanished before its name was watched */
+  if (g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_SERVICE_UNKNOWN) ||
+      g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_NAME_HAS_NO_OWNER))
+    {
+      if (app->cancellable)
+        im_application_list_unset_remote (app);
+      return;
+    }
+
+  g_warning ("could not fetch the list of %s: %s", what, error->message);
+}
+
+/* Adds all sources in @sources, which is in the format of ListSources */
+static void
+application_add_sources (Application *app,
+                         GVariant    *sources)
+{
+  GVariantIter iter;
+  GVariant *source;
+  guint i = 0;
+
+  g_variant_iter_init (&iter, sources);
+  while ((source = g_variant_iter_next_value (&iter)))
+    {
+      im_application_list_source_added (app, i++, source);
+      g_variant_unref (source);
+    }
+}
+
+static void
+im_application_list_sources_listed (GObject      *source_object,
+                                    GAsyncResult *result,
+                                    gpointer      user_data)
+{
+  Application *app = user_data;
+  GVariant *sources;
+  GError *error = NULL;
+
+  if (indicator_messages_application_call_list_sources_finish (INDICATOR_MESSAGES_APPLICATION (source_object),
+                                                               &sources, result, &error))
+    {
+      application_add_sources (app, sources);
+      g_variant_unref (sources);
+    }
+  else
+    {
+      im_application_list_list_failed (app, "sources", error);
+      g_error_free (error);
+    }
+}
+
+static GIcon *
 get_symbolic_app_icon (GDesktopAppInfo *info)
 {
   gchar *x_symbolic_icon;
@@ -1065,6 +2296,28 @@ get_symbolic_app_icon (GDesktopAppInfo *info)
   return symbolic_icon;
 }
 
+/* Returns the serialized symbolic icon of @app, or NULL if it doesn't
+ * have one.  The result is owned by @app. */
+static GVariant *
+application_get_serialized_app_icon (Application *app)
+{
+  if (!app->app_icon_valid)
+    {
+      GIcon *icon;
+
+      icon = get_symbolic_app_icon (app->info);
+      if (icon)
+        {
+          app->serialized_app_icon = g_icon_serialize (icon);
+          g_object_unref (icon);
+        }
+
+      app->app_icon_valid = TRUE;
+    }
+
+  return app->serialized_app_icon;
+}
+
 static void
 im_application_list_message_added (Application *app,
                                    GVariant    *message)
@@ -1077,23 +2330,31 @@ im_application_list_message_added (Application *app,
   gint64 time;
   GVariantIter *action_iter;
   gboolean draws_attention;
-  GVariant *serialized_icon = NULL;
-  GSimpleAction *action;
-  GIcon *app_icon;
+  GVariant *serialized_icon;
+  gchar *icon_hash;
+  gboolean was_drawing_attention;
   GVariant *actions = NULL;
-  gchar *action_name;
+  const gchar *action_name;
+  gchar *tmp;
 
   g_variant_get (message, "(&s@av&s&s&sxaa{sv}b)",
                  &id, &maybe_serialized_icon, &title, &subtitle, &body, &time, &action_iter, &draws_attention);
 
-  if (g_variant_n_children (maybe_serialized_icon) == 1)
-    g_variant_get_child (maybe_serialized_icon, 0, "v", &serialized_icon);
+  serialized_icon = application_resolve_icon (app, maybe_serialized_icon, &icon_hash);
+
+  action_name = escape_action_name (id, &tmp);
+
+  /* adding an action with an existing name replaces the old one, along
+   * with its expiry */
+  if (im_action_table_lookup (app->message_actions, action_name, &was_drawing_attention))
+    {
+      application_update_counters (app, -1, 0, -was_drawing_attention);
+      application_clear_expiry (app, TRUE, action_name);
+    }
 
-  action_name = escape_action_name (id);
-  action = g_simple_action_new (action_name, G_VARIANT_TYPE_BOOLEAN);
-  g_object_set_qdata(G_OBJECT(action), message_action_draws_attention_quark(), GINT_TO_POINTER(draws_attention));
-  g_signal_connect (action, "activate", G_CALLBACK (im_application_list_message_activated), app);
-  g_action_map_add_action (G_ACTION_MAP(app->message_actions), G_ACTION (action));
+  im_action_table_insert (app->message_actions, action_name, NULL, draws_attention != FALSE);
+  application_update_counters (app, 1, 0, draws_attention != FALSE);
+  application_index_message (app, action_name, time, draws_attention != FALSE);
 
   {
     GVariant *entry;
@@ -1112,7 +2373,8 @@ im_application_list_message_added (Application *app,
         GVariant *hint;
         GVariantBuilder dict_builder;
         gchar *prefixed_name;
-        gchar *escaped_name;
+        const gchar *escaped_name;
+        gchar *escaped_tmp;
 
         if (!g_variant_lookup (entry, "name", "&s", &name))
           {
@@ -1124,7 +2386,7 @@ im_application_list_message_added (Application *app,
         g_variant_lookup (entry, "parameter-type", "&g", &type);
         hint = g_variant_lookup_value (entry, "parameter-hint", NULL);
 
-        escaped_name = escape_action_name (name);
+        escaped_name = escape_action_name (name, &escaped_tmp);
         action = g_simple_action_new (escaped_name, type ? G_VARIANT_TYPE (type) : NULL);
         g_object_set_data_full (G_OBJECT (action), "message", g_strdup (id), g_free);
         g_signal_connect (action, "activate", G_CALLBACK (im_application_list_sub_message_activated), app);
@@ -1155,7 +2417,7 @@ im_application_list_message_added (Application *app,
         g_object_unref (action);
         g_variant_unref (entry);
         g_free (prefixed_name);
-        g_free (escaped_name);
+        g_free (escaped_tmp);
       }
 
     g_action_muxer_insert (app->message_sub_actions, action_name, G_ACTION_GROUP (action_group));
@@ -1164,25 +2426,37 @@ im_application_list_message_added (Application *app,
     g_object_unref (action_group);
   }
 
-  if (draws_attention && !app->draws_attention)
-    {
-      app->draws_attention = TRUE;
-      im_application_list_update_root_action (app->list);
-    }
+  im_application_list_update_root_action (app->list);
 
-  app_icon = get_symbolic_app_icon (app->info);
+  application_store_message (app, action_name, serialized_icon, icon_hash, title, subtitle, body, actions);
 
   g_signal_emit (app->list, signals[MESSAGE_ADDED], 0,
-                 app->id, app_icon, action_name, serialized_icon, title,
+                 app->id, application_get_serialized_app_icon (app), action_name, serialized_icon, title,
                  subtitle, body, actions, time, draws_attention);
 
-  g_free (action_name);
+  application_enforce_message_limits (app);
+
+  g_free (tmp);
   g_variant_iter_free (action_iter);
-  g_object_unref (action);
   if (serialized_icon)
     g_variant_unref (serialized_icon);
   g_variant_unref (maybe_serialized_icon);
-  g_object_unref (app_icon);
+}
+
+/* Adds all messages in @messages, which is in the format of ListMessages */
+static void
+application_add_messages (Application *app,
+                          GVariant    *messages)
+{
+  GVariantIter iter;
+  GVariant *message;
+
+  g_variant_iter_init (&iter, messages);
+  while ((message = g_variant_iter_next_value (&iter)))
+    {
+      im_application_list_message_added (app, message);
+      g_variant_unref (message);
+    }
 }
 
 static void
@@ -1194,27 +2468,96 @@ im_application_list_messages_listed (GObject      *source_object,
   GVariant *messages;
   GError *error = NULL;
 
-  if (indicator_messages_application_call_list_messages_finish (app->proxy, &messages, result, &error))
+  if (indicator_messages_application_call_list_messages_finish (INDICATOR_MESSAGES_APPLICATION (source_object),
+                                                                &messages, result, &error))
     {
-      GVariantIter iter;
-      GVariant *message;
+      application_add_messages (app, messages);
+      g_variant_unref (messages);
+    }
+  else
+    {
+      im_application_list_list_failed (app, "messages", error);
+      g_error_free (error);
+    }
+}
 
-      g_variant_iter_init (&iter, messages);
-      while ((message = g_variant_iter_next_value (&iter)))
-        {
-          im_application_list_message_added (app, message);
-          g_variant_unref (message);
-        }
+/* Messages are listed one page at a time, and only as far as the menus
+ * show them (see application_wants_more_messages()), so that
+ * applications with many messages neither need one huge reply nor
+ * stall the service while it is processed. */
+#define MESSAGES_PAGE_SIZE 50
+
+static void im_application_list_message_page_listed (GObject      *source_object,
+                                                     GAsyncResult *result,
+                                                     gpointer      user_data);
+
+static void
+application_list_messages_page (Application *app,
+                                const gchar *cursor)
+{
+  app->listing_messages = TRUE;
+  indicator_messages_application_call_list_messages_page (app->proxy, cursor, MESSAGES_PAGE_SIZE,
+                                                          app->cancellable,
+                                                          im_application_list_message_page_listed, app);
+}
+
+static void
+im_application_list_message_page_listed (GObject      *source_object,
+                                         GAsyncResult *result,
+                                         gpointer      user_data)
+{
+  Application *app = user_data;
+  GVariant *messages;
+  gchar *next_cursor;
+  gboolean attention_after;
+  GError *error = NULL;
+
+  if (indicator_messages_application_call_list_messages_page_finish (INDICATOR_MESSAGES_APPLICATION (source_object),
+                                                                     &messages, &next_cursor, &attention_after,
+                                                                     result, &error))
+    {
+      application_add_messages (app, messages);
+
+      app->listing_messages = FALSE;
+      g_free (app->messages_cursor);
+      app->messages_cursor = next_cursor[0] != '\0' ? g_strdup (next_cursor) : NULL;
+      app->messages_attention_after = attention_after;
+      application_fetch_more_messages (app);
 
       g_variant_unref (messages);
+      g_free (next_cursor);
+    }
+  else if (g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD))
+    {
+      app->listing_messages = FALSE;
+
+      /* only the first page goes to applications which registered
+       * without state, and older ones only have ListMessages */
+      indicator_messages_application_call_list_messages (app->proxy, app->cancellable,
+                                                         im_application_list_messages_listed, app);
+      g_error_free (error);
     }
   else
     {
-      g_warning ("could not fetch the list of messages: %s", error->message);
+      /* @app might be gone if the call was cancelled */
+      if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        app->listing_messages = FALSE;
+      im_application_list_list_failed (app, "messages", error);
       g_error_free (error);
     }
 }
 
+/* Lists the next page of @app's messages if the menus need it */
+static void
+application_fetch_more_messages (Application *app)
+{
+  if (app->proxy == NULL || app->messages_cursor == NULL || app->listing_messages)
+    return;
+
+  if (application_wants_more_messages (app))
+    application_list_messages_page (app, app->messages_cursor);
+}
+
 static void
 im_application_list_unset_remote (Application *app)
 {
@@ -1222,26 +2565,9 @@ im_application_list_unset_remote (Application *app)
 
   was_running = app->proxy || app->cancellable;
 
-  if (app->cancellable)
-    {
-      g_cancellable_cancel (app->cancellable);
-      g_clear_object (&app->cancellable);
-    }
-  g_clear_object (&app->proxy);
-
-  /* clear actions by creating a new action group and overriding it in
-   * the muxer */
-  g_object_unref (app->source_actions);
-  g_object_unref (app->message_actions);
-  g_object_unref (app->message_sub_actions);
-  app->source_actions = g_simple_action_group_new ();
-  app->message_actions = g_simple_action_group_new ();
-  app->message_sub_actions = g_action_muxer_new ();
-  g_action_muxer_insert (app->muxer, "src", G_ACTION_GROUP (app->source_actions));
-  g_action_muxer_insert (app->muxer, "msg", G_ACTION_GROUP (app->message_actions));
-  g_action_muxer_insert (app->muxer, "msg-actions", G_ACTION_GROUP (app->message_sub_actions));
+  application_clear_remote (app);
 
-  app->draws_attention = FALSE;
+  application_reset_actions (app);
   im_application_list_update_root_action (app->list);
 
   g_action_group_change_action_state (G_ACTION_GROUP (app->muxer), "launch", g_variant_new_boolean (FALSE));
@@ -1250,61 +2576,211 @@ im_application_list_unset_remote (Application *app)
     g_signal_emit (app->list, signals[APP_STOPPED], 0, app->id);
 }
 
+static Application *
+im_application_list_lookup_remote (ImApplicationList *list,
+                                   const gchar       *bus_name,
+                                   const gchar       *object_path)
+{
+  GList *it;
+
+  for (it = g_hash_table_lookup (list->remotes, bus_name); it; it = it->next)
+    {
+      Application *app = it->data;
+
+      if (g_str_equal (app->object_path, object_path))
+        return app;
+    }
+
+  return NULL;
+}
+
+/* Applies one of the change signals of the application interface */
 static void
-im_application_list_app_vanished (GDBusConnection *connection,
-                                  const gchar     *name,
-                                  gpointer         user_data)
+application_apply_change (Application *app,
+                          const gchar *signal_name,
+                          GVariant    *parameters)
 {
-  Application *app = user_data;
+  if (g_str_equal (signal_name, "SourceAdded") &&
+      g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(u(ssavuxsb))")))
+    {
+      guint32 position;
+      GVariant *source;
+
+      g_variant_get (parameters, "(u@(ssavuxsb))", &position, &source);
+      im_application_list_source_added (app, position, source);
+      g_variant_unref (source);
+    }
+  else if (g_str_equal (signal_name, "SourceChanged") &&
+           g_variant_is_of_type (parameters, G_VARIANT_TYPE ("((ssavuxsb))")))
+    {
+      GVariant *source;
 
-  im_application_list_unset_remote (app);
+      g_variant_get (parameters, "(@(ssavuxsb))", &source);
+      im_application_list_source_changed (app, source);
+      g_variant_unref (source);
+    }
+  else if (g_str_equal (signal_name, "SourceUpdated") &&
+           g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(sa{sv})")))
+    {
+      const gchar *id;
+      GVariant *changes;
+
+      g_variant_get (parameters, "(&s@a{sv})", &id, &changes);
+      im_application_list_source_updated (app, id, changes);
+      g_variant_unref (changes);
+    }
+  else if (g_str_equal (signal_name, "IconAdded") &&
+           g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(sv)")))
+    {
+      const gchar *hash;
+      GVariant *serialized_icon;
+
+      g_variant_get (parameters, "(&sv)", &hash, &serialized_icon);
+      application_add_icon (app, hash, serialized_icon);
+      g_variant_unref (serialized_icon);
+    }
+  else if (g_str_equal (signal_name, "TimeToLiveSet") &&
+           g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(ssu)")))
+    {
+      const gchar *kind;
+      const gchar *id;
+      guint32 seconds;
+
+      g_variant_get (parameters, "(&s&su)", &kind, &id, &seconds);
+      application_set_time_to_live (app, kind, id, seconds);
+    }
+  else if (g_str_equal (signal_name, "SourceRemoved") &&
+           g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(s)")))
+    {
+      const gchar *id;
+
+      g_variant_get (parameters, "(&s)", &id);
+      im_application_list_source_removed (app, id);
+    }
+  else if (g_str_equal (signal_name, "MessageAdded") &&
+           g_variant_is_of_type (parameters, G_VARIANT_TYPE ("((savsssxaa{sv}b))")))
+    {
+      GVariant *message;
+
+      g_variant_get (parameters, "(@(savsssxaa{sv}b))", &message);
+      im_application_list_message_added (app, message);
+      g_variant_unref (message);
+    }
+  else if (g_str_equal (signal_name, "MessageRemoved") &&
+           g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(s)")))
+    {
+      const gchar *id;
+
+      g_variant_get (parameters, "(&s)", &id);
+      im_application_list_message_removed (app, id);
+    }
 }
 
 static void
-im_application_list_proxy_created (GObject      *source_object,
-                                   GAsyncResult *result,
-                                   gpointer      user_data)
+im_application_list_app_signal (GDBusConnection *connection,
+                                const gchar     *sender_name,
+                                const gchar     *object_path,
+                                const gchar     *interface_name,
+                                const gchar     *signal_name,
+                                GVariant        *parameters,
+                                gpointer         user_data)
 {
-  Application *app = user_data;
-  GError *error = NULL;
+  ImApplicationList *list = user_data;
+  Application *app;
 
-  app->proxy = indicator_messages_application_proxy_new_finish (result, &error);
-  if (!app->proxy)
+  app = im_application_list_lookup_remote (list, sender_name, object_path);
+  if (app == NULL)
+    return;
+
+  if (g_str_equal (signal_name, "Changes"))
     {
-      if (error->code != G_IO_ERROR_CANCELLED)
-        g_warning ("could not create application proxy: %s", error->message);
-      g_error_free (error);
-      return;
+      GVariantIter *iter;
+      const gchar *name;
+      GVariant *change;
+
+      if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(a(sv))")))
+        return;
+
+      /* the root action is updated from idle, and thus only once for
+       * the whole batch */
+      g_variant_get (parameters, "(a(sv))", &iter);
+      while (g_variant_iter_loop (iter, "(&sv)", &name, &change))
+        application_apply_change (app, name, change);
+      g_variant_iter_free (iter);
     }
+  else
+    {
+      application_apply_change (app, signal_name, parameters);
+    }
+}
 
-  indicator_messages_application_call_list_sources (app->proxy, app->cancellable,
-                                                    im_application_list_sources_listed, app);
-  indicator_messages_application_call_list_messages (app->proxy, app->cancellable,
-                                                     im_application_list_messages_listed, app);
+/* Unique names never change owners, so all applications of @name are
+ * gone once it vanished */
+static void
+im_application_list_remote_vanished (GDBusConnection *connection,
+                                     const gchar     *name,
+                                     gpointer         user_data)
+{
+  ImApplicationList *list = user_data;
+  gchar *bus_name;
+  GList *apps;
 
-  g_signal_connect_swapped (app->proxy, "source-added", G_CALLBACK (im_application_list_source_added), app);
-  g_signal_connect_swapped (app->proxy, "source-changed", G_CALLBACK (im_application_list_source_changed), app);
-  g_signal_connect_swapped (app->proxy, "source-removed", G_CALLBACK (im_application_list_source_removed), app);
-  g_signal_connect_swapped (app->proxy, "message-added", G_CALLBACK (im_application_list_message_added), app);
-  g_signal_connect_swapped (app->proxy, "message-removed", G_CALLBACK (im_application_list_message_removed), app);
+  /* unsetting the last application unwatches @name */
+  bus_name = g_strdup (name);
 
-  g_action_group_change_action_state (G_ACTION_GROUP (app->muxer), "launch", g_variant_new_boolean (TRUE));
+  while ((apps = g_hash_table_lookup (list->remotes, bus_name)))
+    im_application_list_unset_remote (apps->data);
 
-  g_bus_watch_name_on_connection (g_dbus_proxy_get_connection (G_DBUS_PROXY (app->proxy)),
-                                  g_dbus_proxy_get_name (G_DBUS_PROXY (app->proxy)),
-                                  G_BUS_NAME_WATCHER_FLAGS_NONE,
-                                  NULL, im_application_list_app_vanished,
-                                  app, NULL);
+  g_free (bus_name);
 }
 
+/*
+ * im_application_list_watch_connection:
+ * @list: an #ImApplicationList
+ * @connection: a #GDBusConnection
+ *
+ * Subscribes to the signals of all applications on @connection, if that
+ * hasn't happened yet.  Doing this before the service is exported makes
+ * sure that no signals are missed between an application sending its
+ * state and it being registered.
+ */
 void
-im_application_list_set_remote (ImApplicationList *list,
-                                const gchar       *id,
-                                GDBusConnection   *connection,
-                                const gchar       *unique_bus_name,
-                                const gchar       *object_path)
+im_application_list_watch_connection (ImApplicationList *list,
+                                      GDBusConnection   *connection)
+{
+  g_return_if_fail (IM_IS_APPLICATION_LIST (list));
+  g_return_if_fail (G_IS_DBUS_CONNECTION (connection));
+
+  if (list->connection == connection)
+    return;
+
+  g_return_if_fail (list->connection == NULL);
+
+  list->connection = g_object_ref (connection);
+
+  list->app_signals_id = g_dbus_connection_signal_subscribe (connection,
+                                                             NULL,
+                                                             "org.ayatana.indicator.messages.application",
+                                                             NULL, NULL, NULL,
+                                                             G_DBUS_SIGNAL_FLAGS_NONE,
+                                                             im_application_list_app_signal,
+                                                             list, NULL);
+}
+
+static void
+im_application_list_set_remote_internal (ImApplicationList *list,
+                                         const gchar       *id,
+                                         GDBusConnection   *connection,
+                                         const gchar       *unique_bus_name,
+                                         const gchar       *object_path,
+                                         GVariant          *sources,
+                                         GVariant          *messages,
+                                         const gchar       *messages_cursor,
+                                         gboolean           messages_attention_after)
 {
   Application *app;
+  GList *apps;
+  GError *error = NULL;
 
   g_return_if_fail (IM_IS_APPLICATION_LIST (list));
 
@@ -1323,24 +2799,115 @@ im_application_list_set_remote (ImApplicationList *list,
 
   if (app->cancellable)
     {
-      gchar *name_owner = NULL;
-
-      if (app->proxy)
-        name_owner = g_dbus_proxy_get_name_owner (G_DBUS_PROXY (app->proxy));
-
-      if (g_strcmp0 (name_owner, unique_bus_name) != 0)
+      if (g_strcmp0 (app->bus_name, unique_bus_name) != 0)
         {
-          g_warning ("replacing '%s' at %s with %s", id, name_owner, unique_bus_name);
+          g_warning ("replacing '%s' at %s with %s", id, app->bus_name, unique_bus_name);
           im_application_list_unset_remote (app);
         }
+      else
+        {
+          application_clear_remote (app);
+        }
+    }
 
-      g_free (name_owner);
+  /* Neither signals nor properties of the proxy are used, which makes
+   * creating it cheap and free of round trips */
+  app->proxy = indicator_messages_application_proxy_new_sync (connection,
+                                                              G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+                                                              G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+                                                              unique_bus_name, object_path, NULL, &error);
+  if (!app->proxy)
+    {
+      g_warning ("could not create application proxy: %s", error->message);
+      g_error_free (error);
+      return;
     }
 
+  im_application_list_watch_connection (list, connection);
+
   app->cancellable = g_cancellable_new ();
-  indicator_messages_application_proxy_new (connection, G_DBUS_PROXY_FLAGS_NONE,
-                                            unique_bus_name, object_path, app->cancellable,
-                                            im_application_list_proxy_created, app);
+  app->bus_name = g_strdup (unique_bus_name);
+  app->object_path = g_strdup (object_path);
+
+  apps = g_hash_table_lookup (list->remotes, app->bus_name);
+  if (apps)
+    {
+      apps = g_list_append (apps, app); /* keeps the head */
+    }
+  else
+    {
+      guint watch_id;
+
+      g_hash_table_insert (list->remotes, g_strdup (app->bus_name), g_list_prepend (NULL, app));
+
+      /* also reports names that vanished before they were watched */
+      watch_id = g_bus_watch_name_on_connection (connection, app->bus_name, G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                 NULL, im_application_list_remote_vanished, list, NULL);
+      g_hash_table_insert (list->remote_watches, g_strdup (app->bus_name), GUINT_TO_POINTER (watch_id));
+    }
+
+  if (sources && messages)
+    {
+      application_add_sources (app, sources);
+      application_add_messages (app, messages);
+      if (messages_cursor && messages_cursor[0] != '\0')
+        {
+          app->messages_cursor = g_strdup (messages_cursor);
+          app->messages_attention_after = messages_attention_after;
+          application_fetch_more_messages (app);
+        }
+    }
+  else
+    {
+      /* The subscriptions are in place before these calls are made.  If
+       * the application vanishes before, the calls fail instead. */
+      indicator_messages_application_call_list_sources (app->proxy, app->cancellable,
+                                                        im_application_list_sources_listed, app);
+      application_list_messages_page (app, "");
+    }
+
+  g_action_group_change_action_state (G_ACTION_GROUP (app->muxer), "launch", g_variant_new_boolean (TRUE));
+}
+
+void
+im_application_list_set_remote (ImApplicationList *list,
+                                const gchar       *id,
+                                GDBusConnection   *connection,
+                                const gchar       *unique_bus_name,
+                                const gchar       *object_path)
+{
+  im_application_list_set_remote_internal (list, id, connection, unique_bus_name, object_path, NULL, NULL, NULL, FALSE);
+}
+
+/*
+ * im_application_list_set_remote_with_state:
+ *
+ * Like im_application_list_set_remote(), but takes the current sources
+ * and messages of the application instead of asking for them.
+ * @sources and @messages are in the format of the results of
+ * ListSources and ListMessages, respectively.  Unless @messages_cursor
+ * is empty, @messages only holds the newest messages and the rest are
+ * listed with ListMessagesPage, starting at @messages_cursor.
+ * @messages_attention_after tells whether any of the rest draws
+ * attention.
+ */
+void
+im_application_list_set_remote_with_state (ImApplicationList *list,
+                                           const gchar       *id,
+                                           GDBusConnection   *connection,
+                                           const gchar       *unique_bus_name,
+                                           const gchar       *object_path,
+                                           GVariant          *sources,
+                                           GVariant          *messages,
+                                           const gchar       *messages_cursor,
+                                           gboolean           messages_attention_after)
+{
+  g_return_if_fail (sources != NULL && g_variant_is_of_type (sources, G_VARIANT_TYPE ("a(ssavuxsb)")));
+  g_return_if_fail (messages != NULL && g_variant_is_of_type (messages, G_VARIANT_TYPE ("a(savsssxaa{sv}b)")));
+  g_return_if_fail (messages_cursor != NULL);
+
+  im_application_list_set_remote_internal (list, id, connection, unique_bus_name, object_path,
+                                           sources, messages, messages_cursor, messages_attention_after);
 }
 
 GActionGroup *
@@ -1371,6 +2938,77 @@ im_application_list_get_application (ImApplicationList *list,
   return app ? app->info : NULL;
 }
 
+/*
+ * im_application_list_foreach_source:
+ *
+ * Calls @func for every source of every application, with the
+ * arguments of the "source-added" signal, in the order the sources of
+ * each application were added.  Menus use this to catch up with the
+ * list when they start listening to its signals.
+ */
+void
+im_application_list_foreach_source (ImApplicationList           *list,
+                                    ImApplicationListSourceFunc  func,
+                                    gpointer                     user_data)
+{
+  GHashTableIter iter;
+  Application *app;
+
+  g_return_if_fail (IM_IS_APPLICATION_LIST (list));
+  g_return_if_fail (func != NULL);
+
+  g_hash_table_iter_init (&iter, list->applications);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &app))
+    {
+      GSequenceIter *it;
+
+      for (it = g_sequence_get_begin_iter (app->source_order);
+           !g_sequence_iter_is_end (it);
+           it = g_sequence_iter_next (it))
+        {
+          SourceEntry *entry = g_sequence_get (it);
+
+          func (list, app->id, entry->action_name, entry->label,
+                entry->serialized_icon, entry->visible, user_data);
+        }
+    }
+}
+
+/*
+ * im_application_list_foreach_message:
+ *
+ * Like im_application_list_foreach_source(), but for messages, with
+ * the arguments of the "message-added" signal, oldest first.
+ */
+void
+im_application_list_foreach_message (ImApplicationList            *list,
+                                     ImApplicationListMessageFunc  func,
+                                     gpointer                      user_data)
+{
+  GHashTableIter iter;
+  Application *app;
+
+  g_return_if_fail (IM_IS_APPLICATION_LIST (list));
+  g_return_if_fail (func != NULL);
+
+  g_hash_table_iter_init (&iter, list->applications);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &app))
+    {
+      GSequenceIter *it;
+
+      for (it = g_sequence_get_begin_iter (app->message_order);
+           !g_sequence_iter_is_end (it);
+           it = g_sequence_iter_next (it))
+        {
+          MessageEntry *entry = g_sequence_get (it);
+
+          func (list, app->id, application_get_serialized_app_icon (app), entry->action_name,
+                entry->serialized_icon, entry->title, entry->subtitle, entry->body,
+                entry->actions, entry->time, entry->draws_attention, user_data);
+        }
+    }
+}
+
 static void
 status_activated (GSimpleAction * action, GVariant * param, gpointer user_data)
 {
@@ -1398,27 +3036,6 @@ status_activated (GSimpleAction * action, GVariant * param, gpointer user_data)
   return;
 }
 
-#define STATUS_ID_OFFLINE  (G_N_ELEMENTS(status_ids) - 1)
-static const gchar *status_ids[] = { "available", "away", "busy", "invisible", "offline" };
-
-static guint
-status2val (const gchar * string)
-{
-	if (string == NULL) return STATUS_ID_OFFLINE;
-
-	guint i;
-	for (i = 0; i < G_N_ELEMENTS(status_ids); i++) {
-		if (g_strcmp0(status_ids[i], string) == 0) {
-			break;
-		}
-	}
-
-	if (i > STATUS_ID_OFFLINE)
-		i = STATUS_ID_OFFLINE;
-
-	return i;
-}
-
 void
 im_application_list_set_status (ImApplicationList * list, const gchar * id, const gchar *status)
 {
@@ -1445,3 +3062,31 @@ im_application_list_set_status (ImApplicationList * list, const gchar * id, cons
 	return;
 }
 
+/*
+ * im_application_list_set_messages_wanted:
+ * @n_messages: how many of each application's newest messages the
+ *   menus need, or G_MAXUINT for all of them
+ *
+ * Applications which list their messages in pages are asked for more
+ * while they have fewer than @n_messages, within the message limits.
+ * Until a menu asks, or with @n_messages 0, only the first page and
+ * the messages that draw attention are fetched.
+ */
+void
+im_application_list_set_messages_wanted (ImApplicationList *list,
+                                         guint              n_messages)
+{
+  GHashTableIter iter;
+  Application *app;
+
+  g_return_if_fail (IM_IS_APPLICATION_LIST (list));
+
+  if (n_messages == list->messages_wanted)
+    return;
+
+  list->messages_wanted = n_messages;
+
+  g_hash_table_iter_init (&iter, list->applications);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &app))
+    application_fetch_more_messages (app);
+}
@@ -32,6 +32,27 @@
 
 typedef struct _ImApplicationList        ImApplicationList;
 
+typedef void (* ImApplicationListSourceFunc)  (ImApplicationList *list,
+                                               const gchar       *app_id,
+                                               const gchar       *source_id,
+                                               const gchar       *label,
+                                               GVariant          *serialized_icon,
+                                               gboolean           visible,
+                                               gpointer           user_data);
+
+typedef void (* ImApplicationListMessageFunc) (ImApplicationList *list,
+                                               const gchar       *app_id,
+                                               GVariant          *serialized_app_icon,
+                                               const gchar       *message_id,
+                                               GVariant          *serialized_icon,
+                                               const gchar       *title,
+                                               const gchar       *subtitle,
+                                               const gchar       *body,
+                                               GVariant          *actions,
+                                               gint64             time,
+                                               gboolean           draws_attention,
+                                               gpointer           user_data);
+
 GType                   im_application_list_get_type            (void);
 
 ImApplicationList *     im_application_list_new                 (void);
@@ -48,6 +69,19 @@ void                    im_application_list_set_remote          (ImApplicationLi
                                                                  const gchar       *unique_bus_name,
                                                                  const gchar       *object_path);
 
+void                    im_application_list_set_remote_with_state (ImApplicationList *list,
+                                                                   const gchar       *id,
+                                                                   GDBusConnection   *connection,
+                                                                   const gchar       *unique_bus_name,
+                                                                   const gchar       *object_path,
+                                                                   GVariant          *sources,
+                                                                   GVariant          *messages,
+                                                                   const gchar       *messages_cursor,
+                                                                   gboolean           messages_attention_after);
+
+void                    im_application_list_watch_connection    (ImApplicationList *list,
+                                                                 GDBusConnection   *connection);
+
 GActionGroup *          im_application_list_get_action_group    (ImApplicationList *list);
 
 GList *                 im_application_list_get_applications    (ImApplicationList *list);
@@ -59,4 +93,15 @@ void                    im_application_list_set_status          (ImApplicationLi
                                                                  const gchar       *id,
                                                                  const gchar       *status);
 
+void                    im_application_list_foreach_source      (ImApplicationList            *list,
+                                                                 ImApplicationListSourceFunc   func,
+                                                                 gpointer                      user_data);
+
+void                    im_application_list_foreach_message     (ImApplicationList            *list,
+                                                                 ImApplicationListMessageFunc  func,
+                                                                 gpointer                      user_data);
+
+void                    im_application_list_set_messages_wanted (ImApplicationList            *list,
+                                                                 guint                         n_messages);
+
 #endif
@@ -19,6 +19,8 @@
 
 #include "im-desktop-menu.h"
 #include "indicator-desktop-shortcuts.h"
+#include "im-app-info-cache.h"
+#include "im-source-section.h"
 #include <glib/gi18n.h>
 
 typedef ImMenuClass ImDesktopMenuClass;
@@ -30,7 +32,8 @@ struct _ImDesktopMenu
   gboolean status_section_visible;
   GMenu *default_chat_client_section;
   GMenu *default_mail_client_section;
-  GHashTable *source_sections;
+  GHashTable *source_sections;  /* app id -> ImSourceSection */
+  ImAppInfoCache *app_infos;
 };
 
 G_DEFINE_TYPE (ImDesktopMenu, im_desktop_menu, IM_TYPE_MENU);
@@ -77,13 +80,14 @@ im_desktop_menu_show_chat_section (ImDesktopMenu *menu)
 }
 
 static gboolean
-g_app_info_is_default_for_uri_scheme (GAppInfo    *info,
-                                      const gchar *uri_scheme)
+im_desktop_menu_is_default_for_uri_scheme (ImDesktopMenu *menu,
+                                           GAppInfo      *info,
+                                           const gchar   *uri_scheme)
 {
   GAppInfo *default_info;
   gboolean is_default = FALSE;
 
-  default_info = g_app_info_get_default_for_uri_scheme (uri_scheme);
+  default_info = im_app_info_cache_get_default_for_uri_scheme (menu->app_infos, uri_scheme);
   if (default_info)
     {
       is_default = g_app_info_equal (info, default_info);
@@ -102,7 +106,7 @@ im_desktop_menu_app_added (ImApplicationList *applist,
   ImDesktopMenu *menu = user_data;
   GMenu *section;
   GMenu *app_section;
-  GMenu *source_section;
+  ImSourceSection *source_section;
   gchar *namespace;
   GMenuItem *item;
 
@@ -159,7 +163,7 @@ im_desktop_menu_app_added (ImApplicationList *applist,
   if (g_desktop_app_info_get_boolean (app_info, "X-MessagingMenu-UsesChatSection"))
     im_desktop_menu_show_chat_section (menu);
 
-  source_section = g_menu_new ();
+  source_section = im_source_section_new ();
 
   section = g_menu_new ();
   g_menu_append_section (section, NULL, G_MENU_MODEL (app_section));
@@ -176,7 +180,7 @@ im_desktop_menu_app_added (ImApplicationList *applist,
       g_menu_remove_all (menu->default_chat_client_section);
       g_menu_append_item (menu->default_chat_client_section, item);
     }
-  else if (g_app_info_is_default_for_uri_scheme (G_APP_INFO (app_info), "mailto"))
+  else if (im_desktop_menu_is_default_for_uri_scheme (menu, G_APP_INFO (app_info), "mailto"))
     {
       g_menu_remove_all (menu->default_mail_client_section);
       g_menu_append_item (menu->default_mail_client_section, item);
@@ -196,65 +200,6 @@ im_desktop_menu_app_added (ImApplicationList *applist,
   g_object_unref (app_section);
 }
 
-static void
-im_desktop_menu_source_section_insert_source (GMenu       *source_section,
-                                              const gchar *source_id,
-                                              const gchar *label,
-                                              GVariant    *serialized_icon,
-                                              gint         pos)
-{
-  GMenuItem *item;
-  gchar *action;
-
-  action = g_strconcat ("src.", source_id, NULL);
-  item = g_menu_item_new (label, NULL);
-  g_menu_item_set_action_and_target_value (item, action, NULL);
-  g_menu_item_set_attribute (item, "x-ayatana-type", "s", "org.ayatana.indicator.messages.source");
-  if (serialized_icon)
-    g_menu_item_set_attribute_value (item, "icon", serialized_icon);
-
-  if (pos >= 0)
-    g_menu_insert_item (source_section, pos, item);
-  else
-    g_menu_append_item (source_section, item);
-
-  g_free (action);
-  g_object_unref (item);
-}
-
-static gint
-im_desktop_menu_source_section_find_source (GMenu       *source_section,
-                                            const gchar *source_id)
-{
-  gint n_items;
-  gchar *action;
-  gint i;
-
-  n_items = g_menu_model_get_n_items (G_MENU_MODEL (source_section));
-  action = g_strconcat ("src.", source_id, NULL);
-
-  for (i = 0; i < n_items; i++)
-    {
-      gchar *item_action;
-
-      if (g_menu_model_get_item_attribute (G_MENU_MODEL (source_section), i, "action", "s", &item_action))
-        {
-          gboolean equal;
-
-          equal = g_str_equal (action, item_action);
-          g_free (item_action);
-
-          if (equal)
-            break;
-        }
-    }
-
-  g_free (action);
-
-  return i < n_items ? i : -1;
-}
-
-
 static void
 im_desktop_menu_source_added (ImApplicationList *applist,
                               const gchar       *app_id,
@@ -265,13 +210,13 @@ im_desktop_menu_source_added (ImApplicationList *applist,
                               gpointer           user_data)
 {
   ImDesktopMenu *menu = user_data;
-  GMenu *source_section;
+  ImSourceSection *source_section;
 
   source_section = g_hash_table_lookup (menu->source_sections, app_id);
   g_return_if_fail (source_section != NULL);
 
   if (visible)
-    im_desktop_menu_source_section_insert_source (source_section, source_id, label, serialized_icon, -1);
+    im_source_section_set_source (source_section, source_id, label, serialized_icon);
 }
 
 static void
@@ -281,15 +226,12 @@ im_desktop_menu_source_removed (ImApplicationList *applist,
                                 gpointer           user_data)
 {
   ImDesktopMenu *menu = user_data;
-  GMenu *source_section;
-  gint pos;
+  ImSourceSection *source_section;
 
   source_section = g_hash_table_lookup (menu->source_sections, app_id);
   g_return_if_fail (source_section != NULL);
 
-  pos = im_desktop_menu_source_section_find_source (source_section, source_id);
-  if (pos >= 0)
-    g_menu_remove (source_section, pos);
+  im_source_section_remove_source (source_section, source_id);
 }
 
 static void
@@ -302,19 +244,15 @@ im_desktop_menu_source_changed (ImApplicationList *applist,
                                 gpointer           user_data)
 {
   ImDesktopMenu *menu = user_data;
-  GMenu *section;
-  gint pos;
+  ImSourceSection *section;
 
   section = g_hash_table_lookup (menu->source_sections, app_id);
   g_return_if_fail (section != NULL);
 
-  pos = im_desktop_menu_source_section_find_source (section, source_id);
-
-  if (pos >= 0)
-    g_menu_remove (section, pos);
-
   if (visible)
-    im_desktop_menu_source_section_insert_source (section, source_id, label, serialized_icon, pos);
+    im_source_section_set_source (section, source_id, label, serialized_icon);
+  else
+    im_source_section_remove_source (section, source_id);
 }
 
 static void
@@ -323,14 +261,11 @@ im_desktop_menu_remove_all (ImApplicationList *applist,
 {
   ImDesktopMenu *menu = user_data;
   GHashTableIter it;
-  GMenu *section;
+  ImSourceSection *section;
 
   g_hash_table_iter_init (&it, menu->source_sections);
   while (g_hash_table_iter_next (&it, NULL, (gpointer *) &section))
-    {
-      while (g_menu_model_get_n_items (G_MENU_MODEL (section)) > 0)
-        g_menu_remove (section, 0);
-    }
+    im_source_section_remove_all (section);
 }
 
 static void
@@ -339,13 +274,44 @@ im_desktop_menu_app_stopped (ImApplicationList *applist,
                              gpointer           user_data)
 {
   ImDesktopMenu *menu = user_data;
-  GMenu *section;
+  ImSourceSection *section;
 
   section = g_hash_table_lookup (menu->source_sections, app_id);
   g_return_if_fail (section != NULL);
 
-  while (g_menu_model_get_n_items (G_MENU_MODEL (section)) > 0)
-    g_menu_remove (section, 0);
+  im_source_section_remove_all (section);
+}
+
+static void
+im_desktop_menu_start (ImMenu *menu)
+{
+  ImApplicationList *applist;
+
+  applist = im_menu_get_application_list (menu);
+
+  g_signal_connect (applist, "source-added", G_CALLBACK (im_desktop_menu_source_added), menu);
+  g_signal_connect (applist, "source-removed", G_CALLBACK (im_desktop_menu_source_removed), menu);
+  g_signal_connect (applist, "source-changed", G_CALLBACK (im_desktop_menu_source_changed), menu);
+  g_signal_connect (applist, "remove-all", G_CALLBACK (im_desktop_menu_remove_all), menu);
+  g_signal_connect (applist, "app-stopped", G_CALLBACK (im_desktop_menu_app_stopped), menu);
+
+  im_application_list_foreach_source (applist, im_desktop_menu_source_added, menu);
+}
+
+static void
+im_desktop_menu_stop (ImMenu *menu)
+{
+  ImApplicationList *applist;
+
+  applist = im_menu_get_application_list (menu);
+
+  g_signal_handlers_disconnect_by_func (applist, im_desktop_menu_source_added, menu);
+  g_signal_handlers_disconnect_by_func (applist, im_desktop_menu_source_removed, menu);
+  g_signal_handlers_disconnect_by_func (applist, im_desktop_menu_source_changed, menu);
+  g_signal_handlers_disconnect_by_func (applist, im_desktop_menu_remove_all, menu);
+  g_signal_handlers_disconnect_by_func (applist, im_desktop_menu_app_stopped, menu);
+
+  im_desktop_menu_remove_all (applist, menu);
 }
 
 static void
@@ -387,12 +353,10 @@ im_desktop_menu_constructed (GObject *object)
   }
 
 
+  /* applications are few and rarely change, so their sections are kept
+   * even while nobody is subscribed; sources are only followed while
+   * the menu is started */
   g_signal_connect (applist, "app-added", G_CALLBACK (im_desktop_menu_app_added), menu);
-  g_signal_connect (applist, "source-added", G_CALLBACK (im_desktop_menu_source_added), menu);
-  g_signal_connect (applist, "source-removed", G_CALLBACK (im_desktop_menu_source_removed), menu);
-  g_signal_connect (applist, "source-changed", G_CALLBACK (im_desktop_menu_source_changed), menu);
-  g_signal_connect (applist, "remove-all", G_CALLBACK (im_desktop_menu_remove_all), menu);
-  g_signal_connect (applist, "app-stopped", G_CALLBACK (im_desktop_menu_app_stopped), menu);
 
   G_OBJECT_CLASS (im_desktop_menu_parent_class)->constructed (object);
 }
@@ -403,6 +367,7 @@ im_desktop_menu_finalize (GObject *object)
   ImDesktopMenu *menu = IM_DESKTOP_MENU (object);
 
   g_hash_table_unref (menu->source_sections);
+  g_object_unref (menu->app_infos);
 
   G_OBJECT_CLASS (im_desktop_menu_parent_class)->finalize (object);
 }
@@ -414,12 +379,16 @@ im_desktop_menu_class_init (ImDesktopMenuClass *klass)
 
   object_class->constructed = im_desktop_menu_constructed;
   object_class->finalize = im_desktop_menu_finalize;
+
+  klass->start = im_desktop_menu_start;
+  klass->stop = im_desktop_menu_stop;
 }
 
 static void
 im_desktop_menu_init (ImDesktopMenu *menu)
 {
   menu->source_sections = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
+  menu->app_infos = im_app_info_cache_ref_default ();
 }
 
 ImDesktopMenu *
@@ -0,0 +1,207 @@
+/*
+ * Copyright 2026 Ayatana Indicators
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "im-icon-store.h"
+
+/*
+ * ImIconStore keeps one copy of every serialized icon that applications
+ * have uploaded with IconAdded, keyed by the hash of its contents.
+ * Sources and messages refer to icons by that hash, and all menus are
+ * handed the same GVariant instance, so that an avatar that is shown
+ * for many messages, or by several applications, is only stored once.
+ *
+ * Entries count how often they have been inserted and are dropped when
+ * all of them have been released.
+ */
+
+typedef GObjectClass ImIconStoreClass;
+
+struct _ImIconStore
+{
+  GObject parent;
+
+  GHashTable *icons;  /* hash -> IconEntry */
+};
+
+typedef struct
+{
+  GVariant *serialized_icon;
+  guint refs;
+} IconEntry;
+
+G_DEFINE_TYPE (ImIconStore, im_icon_store, G_TYPE_OBJECT);
+
+static void
+icon_entry_free (gpointer data)
+{
+  IconEntry *entry = data;
+
+  g_variant_unref (entry->serialized_icon);
+  g_slice_free (IconEntry, entry);
+}
+
+static void
+im_icon_store_finalize (GObject *object)
+{
+  ImIconStore *store = IM_ICON_STORE (object);
+
+  g_hash_table_unref (store->icons);
+
+  G_OBJECT_CLASS (im_icon_store_parent_class)->finalize (object);
+}
+
+static void
+im_icon_store_class_init (ImIconStoreClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = im_icon_store_finalize;
+}
+
+static void
+im_icon_store_init (ImIconStore *store)
+{
+  store->icons = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, icon_entry_free);
+}
+
+/* Gets a reference to the store that is shared by the whole service */
+ImIconStore *
+im_icon_store_ref_default (void)
+{
+  static ImIconStore *store = NULL;
+
+  if (store == NULL)
+    {
+      store = g_object_new (IM_TYPE_ICON_STORE, NULL);
+      g_object_add_weak_pointer (G_OBJECT (store), (gpointer *) &store);
+      return store;
+    }
+
+  return g_object_ref (store);
+}
+
+/*
+ * im_icon_store_compute_hash:
+ * @serialized_icon: a serialized #GIcon
+ *
+ * Computes the hash by which @serialized_icon is referred to: the
+ * SHA-256 of the serialized data of @serialized_icon in normal form,
+ * wrapped in a variant so that its type is included.  libmessaging-menu
+ * computes the same hash.
+ *
+ * Returns: a newly allocated hex string
+ */
+gchar *
+im_icon_store_compute_hash (GVariant *serialized_icon)
+{
+  GVariant *boxed;
+  GVariant *normal;
+  gchar *hash;
+
+  g_return_val_if_fail (serialized_icon != NULL, NULL);
+
+  boxed = g_variant_ref_sink (g_variant_new_variant (serialized_icon));
+  normal = g_variant_get_normal_form (boxed);
+
+  hash = g_compute_checksum_for_data (G_CHECKSUM_SHA256,
+                                      g_variant_get_data (normal),
+                                      g_variant_get_size (normal));
+
+  g_variant_unref (normal);
+  g_variant_unref (boxed);
+
+  return hash;
+}
+
+/*
+ * im_icon_store_insert:
+ * @store: an #ImIconStore
+ * @hash: the hash of @serialized_icon
+ * @serialized_icon: a serialized #GIcon
+ *
+ * Adds a reference to the icon with @hash, storing @serialized_icon if
+ * the icon is not known yet.  @hash must match the contents of
+ * @serialized_icon, so that one application can't replace the icons of
+ * another.  Each successful call must be balanced by
+ * im_icon_store_release().
+ *
+ * Returns: (transfer full): the shared copy of the icon, or %NULL if
+ * @hash doesn't match @serialized_icon
+ */
+GVariant *
+im_icon_store_insert (ImIconStore *store,
+                      const gchar *hash,
+                      GVariant    *serialized_icon)
+{
+  IconEntry *entry;
+
+  g_return_val_if_fail (IM_IS_ICON_STORE (store), NULL);
+  g_return_val_if_fail (hash != NULL, NULL);
+  g_return_val_if_fail (serialized_icon != NULL, NULL);
+
+  entry = g_hash_table_lookup (store->icons, hash);
+  if (entry == NULL)
+    {
+      gchar *actual_hash;
+
+      actual_hash = im_icon_store_compute_hash (serialized_icon);
+      if (!g_str_equal (actual_hash, hash))
+        {
+          g_free (actual_hash);
+          return NULL;
+        }
+
+      entry = g_slice_new (IconEntry);
+      entry->serialized_icon = g_variant_get_normal_form (serialized_icon);
+      entry->refs = 0;
+      g_hash_table_insert (store->icons, actual_hash, entry);
+    }
+
+  entry->refs++;
+
+  return g_variant_ref (entry->serialized_icon);
+}
+
+/*
+ * im_icon_store_release:
+ * @store: an #ImIconStore
+ * @hash: the hash of an icon
+ *
+ * Drops a reference that was added with im_icon_store_insert().
+ */
+void
+im_icon_store_release (ImIconStore *store,
+                       const gchar *hash)
+{
+  IconEntry *entry;
+
+  g_return_if_fail (IM_IS_ICON_STORE (store));
+  g_return_if_fail (hash != NULL);
+
+  entry = g_hash_table_lookup (store->icons, hash);
+  g_return_if_fail (entry != NULL);
+
+  if (--entry->refs == 0)
+    g_hash_table_remove (store->icons, hash);
+}
+
+guint
+im_icon_store_get_n_icons (ImIconStore *store)
+{
+  g_return_val_if_fail (IM_IS_ICON_STORE (store), 0);
+
+  return g_hash_table_size (store->icons);
+}
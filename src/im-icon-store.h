@@ -0,0 +1,43 @@
+/*
+ * Copyright 2026 Ayatana Indicators
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __IM_ICON_STORE_H__
+#define __IM_ICON_STORE_H__
+
+#include <gio/gio.h>
+
+#define IM_TYPE_ICON_STORE            (im_icon_store_get_type ())
+#define IM_ICON_STORE(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), IM_TYPE_ICON_STORE, ImIconStore))
+#define IM_IS_ICON_STORE(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), IM_TYPE_ICON_STORE))
+
+typedef struct _ImIconStore ImIconStore;
+
+GType                   im_icon_store_get_type                  (void);
+
+ImIconStore *           im_icon_store_ref_default               (void);
+
+gchar *                 im_icon_store_compute_hash              (GVariant    *serialized_icon);
+
+GVariant *              im_icon_store_insert                    (ImIconStore *store,
+                                                                 const gchar *hash,
+                                                                 GVariant    *serialized_icon);
+
+void                    im_icon_store_release                   (ImIconStore *store,
+                                                                 const gchar *hash);
+
+guint                   im_icon_store_get_n_icons               (ImIconStore *store);
+
+#endif
@@ -20,6 +20,9 @@
 #include "im-menu.h"
 #include "im-accounts-service.h"
 
+#include <string.h>
+#include <locale.h>
+
 struct _ImMenuPrivate
 {
   GMenu *toplevel_menu;
@@ -27,10 +30,65 @@ struct _ImMenuPrivate
   ImApplicationList *applist;
   gboolean on_greeter;
   ImAccountsService *as;
+
+  /* SortKey or NULL for every item of @menu, see
+   * im_menu_insert_item_sorted() */
+  GPtrArray *sort_keys;
+  gchar *collate_locale;
+
+  /* clients that subscribed to the exported menu, by unique name; the
+   * menu is started while there is at least one */
+  GDBusConnection *connection;
+  GArray *filter_ids;
+  GHashTable *subscribers;  /* unique name -> Subscriber */
+  guint n_holds;
+  gboolean started;
 };
 
+/* Passed to the connection's filter, which runs in the GDBus worker
+ * thread.  The filter may still run after the menu was finalized, so
+ * it only holds a weak reference to it. */
+typedef struct
+{
+  GWeakRef menu;
+  gchar *object_path;
+  GMainContext *context;
+} MenuExport;
+
+typedef struct
+{
+  guint n_groups;
+  guint watch_id;
+} Subscriber;
+
+typedef struct
+{
+  ImMenu *menu;
+  gchar *sender;
+  gint delta;
+} SubscriptionChange;
+
+typedef struct
+{
+  gchar *sort_string;
+  gchar *collate_key;
+} SortKey;
+
 G_DEFINE_TYPE_WITH_PRIVATE (ImMenu, im_menu, G_TYPE_OBJECT)
 
+static void
+sort_key_free (gpointer data)
+{
+  SortKey *key = data;
+
+  if (key == NULL)
+    return;
+
+  g_free (key->sort_string);
+  g_free (key->collate_key);
+  g_slice_free (SortKey, key);
+}
+
 enum
 {
   PROP_0,
@@ -39,15 +97,173 @@ enum
   NUM_PROPERTIES
 };
 
+static void
+subscriber_free (gpointer data)
+{
+  Subscriber *subscriber = data;
+
+  g_bus_unwatch_name (subscriber->watch_id);
+  g_slice_free (Subscriber, subscriber);
+}
+
+static void
+menu_export_free (gpointer data)
+{
+  MenuExport *export = data;
+
+  g_weak_ref_clear (&export->menu);
+  g_free (export->object_path);
+  g_main_context_unref (export->context);
+  g_slice_free (MenuExport, export);
+}
+
+static void
+subscription_change_free (gpointer data)
+{
+  SubscriptionChange *change = data;
+
+  g_object_unref (change->menu);
+  g_free (change->sender);
+  g_slice_free (SubscriptionChange, change);
+}
+
+static void
+im_menu_update_started (ImMenu *menu)
+{
+  ImMenuPrivate *priv = im_menu_get_instance_private (menu);
+  ImMenuClass *class = IM_MENU_GET_CLASS (menu);
+  gboolean started;
+
+  started = g_hash_table_size (priv->subscribers) > 0 || priv->n_holds > 0;
+  if (started == priv->started)
+    return;
+
+  priv->started = started;
+
+  if (started && class->start)
+    class->start (menu);
+  else if (!started && class->stop)
+    class->stop (menu);
+}
+
+static void
+im_menu_subscriber_vanished (GDBusConnection *connection,
+                             const gchar     *name,
+                             gpointer         user_data)
+{
+  ImMenu *menu = user_data;
+  ImMenuPrivate *priv = im_menu_get_instance_private (menu);
+
+  g_hash_table_remove (priv->subscribers, name);
+  im_menu_update_started (menu);
+}
+
+static gboolean
+im_menu_subscription_changed (gpointer user_data)
+{
+  SubscriptionChange *change = user_data;
+  ImMenuPrivate *priv = im_menu_get_instance_private (change->menu);
+  Subscriber *subscriber;
+
+  subscriber = g_hash_table_lookup (priv->subscribers, change->sender);
+  if (subscriber == NULL)
+    {
+      if (change->delta <= 0)
+        return G_SOURCE_REMOVE;
+
+      subscriber = g_slice_new0 (Subscriber);
+      subscriber->watch_id = g_bus_watch_name_on_connection (priv->connection, change->sender,
+                                                             G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                             NULL, im_menu_subscriber_vanished,
+                                                             change->menu, NULL);
+      g_hash_table_insert (priv->subscribers, g_strdup (change->sender), subscriber);
+    }
+
+  if ((gint) subscriber->n_groups + change->delta > 0)
+    subscriber->n_groups += change->delta;
+  else
+    g_hash_table_remove (priv->subscribers, change->sender);
+
+  im_menu_update_started (change->menu);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Watches for the Start and End calls of org.gtk.Menus, which clients
+ * make to subscribe to groups of the menu, and forwards them to the
+ * main context.  The menu exporter still handles the calls. */
+static GDBusMessage *
+im_menu_filter_message (GDBusConnection *connection,
+                        GDBusMessage    *message,
+                        gboolean         incoming,
+                        gpointer         user_data)
+{
+  MenuExport *export = user_data;
+  const gchar *member;
+  GVariant *body;
+  GVariant *groups;
+  gint delta;
+  ImMenu *menu;
+  SubscriptionChange *change;
+  GSource *source;
+
+  if (!incoming ||
+      g_dbus_message_get_message_type (message) != G_DBUS_MESSAGE_TYPE_METHOD_CALL ||
+      g_strcmp0 (g_dbus_message_get_path (message), export->object_path) != 0 ||
+      g_strcmp0 (g_dbus_message_get_interface (message), "org.gtk.Menus") != 0)
+    return message;
+
+  body = g_dbus_message_get_body (message);
+  if (body == NULL || !g_variant_is_of_type (body, G_VARIANT_TYPE ("(au)")))
+    return message;
+
+  groups = g_variant_get_child_value (body, 0);
+  delta = g_variant_n_children (groups);
+  g_variant_unref (groups);
+
+  member = g_dbus_message_get_member (message);
+  if (g_strcmp0 (member, "End") == 0)
+    delta = -delta;
+  else if (g_strcmp0 (member, "Start") != 0)
+    return message;
+
+  menu = g_weak_ref_get (&export->menu);
+  if (menu == NULL)
+    return message;
+
+  change = g_slice_new (SubscriptionChange);
+  change->menu = menu;
+  change->sender = g_strdup (g_dbus_message_get_sender (message));
+  change->delta = delta;
+
+  /* queued before the exporter's own handling of the call */
+  source = g_idle_source_new ();
+  g_source_set_priority (source, G_PRIORITY_DEFAULT);
+  g_source_set_callback (source, im_menu_subscription_changed, change, subscription_change_free);
+  g_source_attach (source, export->context);
+  g_source_unref (source);
+
+  return message;
+}
+
 static void
 im_menu_finalize (GObject *object)
 {
   ImMenuPrivate *priv = im_menu_get_instance_private (IM_MENU (object));
+  guint i;
+
+  for (i = 0; i < priv->filter_ids->len; i++)
+    g_dbus_connection_remove_filter (priv->connection, g_array_index (priv->filter_ids, guint, i));
+  g_array_unref (priv->filter_ids);
+  g_hash_table_unref (priv->subscribers);
+  g_clear_object (&priv->connection);
 
   g_object_unref (priv->toplevel_menu);
   g_object_unref (priv->menu);
   g_object_unref (priv->applist);
   g_object_unref (priv->as);
+  g_ptr_array_unref (priv->sort_keys);
+  g_free (priv->collate_locale);
 
   G_OBJECT_CLASS (im_menu_parent_class)->finalize (object);
 }
@@ -129,6 +345,9 @@ im_menu_init (ImMenu *menu)
   priv->menu = g_menu_new ();
   priv->on_greeter = FALSE;
   priv->as = im_accounts_service_ref_default();
+  priv->sort_keys = g_ptr_array_new_with_free_func (sort_key_free);
+  priv->filter_ids = g_array_new (FALSE, FALSE, sizeof (guint));
+  priv->subscribers = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, subscriber_free);
 
   root = g_menu_item_new (NULL, "indicator.messages");
   g_menu_item_set_attribute (root, "x-ayatana-type", "s", "org.ayatana.indicator.root");
@@ -157,14 +376,33 @@ im_menu_export (ImMenu           *menu,
                 GError          **error)
 {
   ImMenuPrivate *priv;
+  MenuExport *export;
+  guint filter_id;
 
   g_return_val_if_fail (IM_IS_MENU (menu), FALSE);
 
   priv = im_menu_get_instance_private (menu);
-  return g_dbus_connection_export_menu_model (connection,
-                                              object_path,
-                                              G_MENU_MODEL (priv->toplevel_menu),
-                                              error) > 0;
+  g_return_val_if_fail (priv->connection == NULL || priv->connection == connection, FALSE);
+
+  if (g_dbus_connection_export_menu_model (connection,
+                                           object_path,
+                                           G_MENU_MODEL (priv->toplevel_menu),
+                                           error) == 0)
+    return FALSE;
+
+  /* the menu is only started once a client subscribes to it */
+  if (priv->connection == NULL)
+    priv->connection = g_object_ref (connection);
+
+  export = g_slice_new (MenuExport);
+  g_weak_ref_init (&export->menu, menu);
+  export->object_path = g_strdup (object_path);
+  export->context = g_main_context_ref_thread_default ();
+
+  filter_id = g_dbus_connection_add_filter (connection, im_menu_filter_message, export, menu_export_free);
+  g_array_append_val (priv->filter_ids, filter_id);
+
+  return TRUE;
 }
 
 void
@@ -179,6 +417,7 @@ im_menu_prepend_section (ImMenu     *menu,
   priv = im_menu_get_instance_private (menu);
 
   g_menu_prepend_section (priv->menu, NULL, section);
+  g_ptr_array_insert (priv->sort_keys, 0, NULL);
 }
 
 void
@@ -193,12 +432,42 @@ im_menu_append_section (ImMenu     *menu,
   priv = im_menu_get_instance_private (menu);
 
   g_menu_append_section (priv->menu, NULL, section);
+  g_ptr_array_add (priv->sort_keys, NULL);
+}
+
+/* Collation keys depend on LC_COLLATE; rebuild them when it changed
+ * since they were computed */
+static void
+im_menu_update_collate_keys (ImMenuPrivate *priv)
+{
+  const gchar *locale;
+  guint i;
+
+  locale = setlocale (LC_COLLATE, NULL);
+  if (g_strcmp0 (locale, priv->collate_locale) == 0)
+    return;
+
+  g_free (priv->collate_locale);
+  priv->collate_locale = g_strdup (locale);
+
+  for (i = 0; i < priv->sort_keys->len; i++)
+    {
+      SortKey *key = g_ptr_array_index (priv->sort_keys, i);
+
+      if (key)
+        {
+          g_free (key->collate_key);
+          key->collate_key = g_utf8_collate_key (key->sort_string, -1);
+        }
+    }
 }
 
 /*
  * Inserts @item into @menu by comparing its
- * "x-messaging-menu-sort-string" with those found in existing menu
- * items between positions @first and @last.
+ * "x-messaging-menu-sort-string" with those of the items that were
+ * inserted with this function between positions @first and @last.
+ * Items without a sort string must come before all others in that
+ * range.
  *
  * If @last is negative, it is counted from the end of @menu.
  */
@@ -211,6 +480,7 @@ im_menu_insert_item_sorted (ImMenu    *menu,
   ImMenuPrivate *priv;
   gint position = first;
   gchar *sort_string;
+  SortKey *key = NULL;
 
   g_return_if_fail (IM_IS_MENU (menu));
   g_return_if_fail (G_IS_MENU_ITEM (item));
@@ -224,25 +494,70 @@ im_menu_insert_item_sorted (ImMenu    *menu,
 
   if (g_menu_item_get_attribute (item, "x-messaging-menu-sort-string", "s", &sort_string))
     {
-      while (position < last)
-        {
-          gchar *item_sort;
+      gint end = last;
+
+      im_menu_update_collate_keys (priv);
 
-          if (g_menu_model_get_item_attribute(G_MENU_MODEL(priv->menu), position, "x-messaging-menu-sort-string", "s", &item_sort))
-            {
-              gint cmp;
+      key = g_slice_new (SortKey);
+      key->sort_string = sort_string;
+      key->collate_key = g_utf8_collate_key (sort_string, -1);
 
-              cmp = g_utf8_collate(sort_string, item_sort);
-              g_free (item_sort);
-              if (cmp < 0)
-                break;
-            }
+      /* after all items that sort before or equal to @item */
+      while (position < end)
+        {
+          gint mid = position + (end - position) / 2;
+          SortKey *mid_key = g_ptr_array_index (priv->sort_keys, mid);
 
-          position++;
+          if (mid_key == NULL || strcmp (key->collate_key, mid_key->collate_key) >= 0)
+            position = mid + 1;
+          else
+            end = mid;
         }
     }
 
   g_menu_insert_item (priv->menu, position, item);
+  g_ptr_array_insert (priv->sort_keys, position, key);
+}
+
+/* Keeps @menu started as if a client was subscribed to it, for menus
+ * that show its items */
+void
+im_menu_hold (ImMenu *menu)
+{
+  ImMenuPrivate *priv;
+
+  g_return_if_fail (IM_IS_MENU (menu));
+
+  priv = im_menu_get_instance_private (menu);
+  priv->n_holds++;
+  im_menu_update_started (menu);
+}
+
+void
+im_menu_release (ImMenu *menu)
+{
+  ImMenuPrivate *priv;
+
+  g_return_if_fail (IM_IS_MENU (menu));
+
+  priv = im_menu_get_instance_private (menu);
+  g_return_if_fail (priv->n_holds > 0);
+
+  priv->n_holds--;
+  im_menu_update_started (menu);
+}
+
+/* Whether a client is subscribed to the menu.  Menus only follow the
+ * application list while they are started. */
+gboolean
+im_menu_is_started (ImMenu *menu)
+{
+  ImMenuPrivate *priv;
+
+  g_return_val_if_fail (IM_IS_MENU (menu), FALSE);
+
+  priv = im_menu_get_instance_private (menu);
+  return priv->started;
 }
 
 /* Whether the menu should show extra data on it. Depends on the greeter
@@ -37,6 +37,11 @@ typedef struct _ImMenuPrivate ImMenuPrivate;
 struct _ImMenuClass
 {
   GObjectClass parent_class;
+
+  /* called when the first client subscribes to the exported menu, and
+   * after the last one went away */
+  void (* start) (ImMenu *menu);
+  void (* stop)  (ImMenu *menu);
 };
 
 struct _ImMenu
@@ -66,4 +71,10 @@ void                    im_menu_insert_item_sorted                      (ImMenu
 
 gboolean                im_menu_show_data                               (ImMenu *menu);
 
+gboolean                im_menu_is_started                              (ImMenu *menu);
+
+void                    im_menu_hold                                    (ImMenu *menu);
+
+void                    im_menu_release                                 (ImMenu *menu);
+
 #endif
@@ -0,0 +1,533 @@
+/*
+ * Copyright 2026 Ayatana Indicators
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "im-message-section.h"
+
+#include <string.h>
+#include <glib/gi18n.h>
+
+/*
+ * ImMessageSection is the message section of the phone menus.  It keeps
+ * all messages sorted by time, newest first, but only exposes the
+ * newest @window_size of them as menu items, followed by a "Show More"
+ * item when there are more.  Clients only ever download that window,
+ * no matter how many messages are waiting.  When a visible message is
+ * removed, the next one slides in from the backing store.
+ *
+ * Messages are identified by a key (the phone menus use the message's
+ * action name) and belong to an application, so that they can be
+ * removed without looking at the items.
+ *
+ * A section created with im_message_section_new_view() has no messages
+ * of its own.  It shows the items of another section, leaving out a
+ * set of private attributes while it is masked.
+ */
+
+typedef GMenuModelClass ImMessageSectionClass;
+
+struct _ImMessageSection
+{
+  GMenuModel parent;
+
+  GSequence *messages;        /* MessageNode, newest first */
+  GHashTable *message_index;  /* key -> GSequenceIter */
+  GHashTable *app_messages;   /* app id -> set of GSequenceIter */
+
+  guint window_size;          /* 0 shows all messages */
+  guint n_visible;            /* MIN (window_size, number of messages) */
+  gboolean show_more;
+
+  GHashTable *more_attributes;
+
+  /* only set for views */
+  ImMessageSection *source;
+  gchar **private_attributes;
+  gboolean masked;
+};
+
+typedef struct
+{
+  gchar *app_id;
+  gchar *key;
+  gint64 time;
+  GHashTable *attributes;
+} MessageNode;
+
+G_DEFINE_TYPE (ImMessageSection, im_message_section, G_TYPE_MENU_MODEL);
+
+static void
+message_node_free (gpointer data)
+{
+  MessageNode *node = data;
+
+  g_free (node->app_id);
+  g_free (node->key);
+  g_hash_table_unref (node->attributes);
+
+  g_slice_free (MessageNode, node);
+}
+
+/* newest first; messages with the same time are ordered by key to keep
+ * the order stable */
+static gint
+message_node_compare (gconstpointer a,
+                      gconstpointer b,
+                      gpointer      user_data)
+{
+  const MessageNode *node_a = a;
+  const MessageNode *node_b = b;
+
+  if (node_a->time != node_b->time)
+    return node_a->time > node_b->time ? -1 : 1;
+
+  return strcmp (node_a->key, node_b->key);
+}
+
+/* The "Show More" item always comes right after the visible messages */
+static void
+im_message_section_update_more_item (ImMessageSection *section)
+{
+  gboolean show_more;
+
+  show_more = (guint) g_sequence_get_length (section->messages) > section->n_visible;
+  if (show_more == section->show_more)
+    return;
+
+  section->show_more = show_more;
+  g_menu_model_items_changed (G_MENU_MODEL (section), section->n_visible,
+                              show_more ? 0 : 1, show_more ? 1 : 0);
+}
+
+static void
+im_message_section_remove_iter (ImMessageSection *section,
+                                GSequenceIter    *iter)
+{
+  MessageNode *node = g_sequence_get (iter);
+  GHashTable *app_messages;
+  guint pos;
+
+  pos = g_sequence_iter_get_position (iter);
+
+  app_messages = g_hash_table_lookup (section->app_messages, node->app_id);
+  if (app_messages)
+    {
+      g_hash_table_remove (app_messages, iter);
+      if (g_hash_table_size (app_messages) == 0)
+        g_hash_table_remove (section->app_messages, node->app_id);
+    }
+
+  g_hash_table_remove (section->message_index, node->key);
+  g_sequence_remove (iter);
+
+  if (pos < section->n_visible)
+    {
+      section->n_visible--;
+      g_menu_model_items_changed (G_MENU_MODEL (section), pos, 1, 0);
+
+      /* slide in the next message, if there is one */
+      if ((guint) g_sequence_get_length (section->messages) > section->n_visible)
+        {
+          section->n_visible++;
+          g_menu_model_items_changed (G_MENU_MODEL (section), section->n_visible - 1, 0, 1);
+        }
+    }
+
+  im_message_section_update_more_item (section);
+}
+
+static gboolean
+im_message_section_is_private_attribute (ImMessageSection *view,
+                                        const gchar      *name)
+{
+  gchar **it;
+
+  for (it = view->private_attributes; *it; it++)
+    if (g_str_equal (*it, name))
+      return TRUE;
+
+  return FALSE;
+}
+
+static gboolean
+im_message_section_is_mutable (GMenuModel *model)
+{
+  return TRUE;
+}
+
+static gint
+im_message_section_get_n_items (GMenuModel *model)
+{
+  ImMessageSection *section = IM_MESSAGE_SECTION (model);
+
+  if (section->source)
+    return im_message_section_get_n_items (G_MENU_MODEL (section->source));
+
+  return section->n_visible + (section->show_more ? 1 : 0);
+}
+
+static void
+im_message_section_get_item_attributes (GMenuModel  *model,
+                                        gint         position,
+                                        GHashTable **table)
+{
+  ImMessageSection *section = IM_MESSAGE_SECTION (model);
+
+  if (section->source)
+    {
+      GHashTable *attributes;
+      GHashTableIter iter;
+      gpointer name;
+      gpointer value;
+
+      im_message_section_get_item_attributes (G_MENU_MODEL (section->source), position, &attributes);
+      if (!section->masked)
+        {
+          *table = attributes;
+          return;
+        }
+
+      /* the masked copy only lives as long as the caller needs it */
+      *table = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) g_variant_unref);
+      g_hash_table_iter_init (&iter, attributes);
+      while (g_hash_table_iter_next (&iter, &name, &value))
+        {
+          if (!im_message_section_is_private_attribute (section, name))
+            g_hash_table_insert (*table, name, g_variant_ref (value));
+        }
+
+      g_hash_table_unref (attributes);
+    }
+  else if ((guint) position < section->n_visible)
+    {
+      MessageNode *node;
+
+      node = g_sequence_get (g_sequence_get_iter_at_pos (section->messages, position));
+      *table = g_hash_table_ref (node->attributes);
+    }
+  else
+    {
+      *table = g_hash_table_ref (section->more_attributes);
+    }
+}
+
+static void
+im_message_section_get_item_links (GMenuModel  *model,
+                                   gint         position,
+                                   GHashTable **table)
+{
+  *table = g_hash_table_new (NULL, NULL);
+}
+
+static void
+im_message_section_source_items_changed (GMenuModel *source,
+                                         gint        position,
+                                         gint        removed,
+                                         gint        added,
+                                         gpointer    user_data)
+{
+  g_menu_model_items_changed (G_MENU_MODEL (user_data), position, removed, added);
+}
+
+static void
+im_message_section_finalize (GObject *object)
+{
+  ImMessageSection *section = IM_MESSAGE_SECTION (object);
+
+  if (section->source)
+    {
+      g_signal_handlers_disconnect_by_func (section->source, im_message_section_source_items_changed, section);
+      g_object_unref (section->source);
+      g_strfreev (section->private_attributes);
+    }
+
+  g_hash_table_unref (section->message_index);
+  g_hash_table_unref (section->app_messages);
+  g_sequence_free (section->messages);
+  g_hash_table_unref (section->more_attributes);
+
+  G_OBJECT_CLASS (im_message_section_parent_class)->finalize (object);
+}
+
+static void
+im_message_section_class_init (ImMessageSectionClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GMenuModelClass *model_class = G_MENU_MODEL_CLASS (klass);
+
+  object_class->finalize = im_message_section_finalize;
+
+  model_class->is_mutable = im_message_section_is_mutable;
+  model_class->get_n_items = im_message_section_get_n_items;
+  model_class->get_item_attributes = im_message_section_get_item_attributes;
+  model_class->get_item_links = im_message_section_get_item_links;
+}
+
+static void
+im_message_section_init (ImMessageSection *section)
+{
+  section->messages = g_sequence_new (message_node_free);
+  section->message_index = g_hash_table_new (g_str_hash, g_str_equal);
+  section->app_messages = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                                 (GDestroyNotify) g_hash_table_unref);
+
+  section->more_attributes = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                                    (GDestroyNotify) g_variant_unref);
+  g_hash_table_insert (section->more_attributes, G_MENU_ATTRIBUTE_LABEL,
+                       g_variant_ref_sink (g_variant_new_string (_("Show More"))));
+  g_hash_table_insert (section->more_attributes, G_MENU_ATTRIBUTE_ACTION,
+                       g_variant_ref_sink (g_variant_new_string ("show-more-messages")));
+  g_hash_table_insert (section->more_attributes, "x-ayatana-type",
+                       g_variant_ref_sink (g_variant_new_string ("org.ayatana.indicator.button")));
+}
+
+/*
+ * im_message_section_new:
+ * @window_size: the number of messages to show, or 0 to show all
+ */
+ImMessageSection *
+im_message_section_new (guint window_size)
+{
+  ImMessageSection *section;
+
+  section = g_object_new (IM_TYPE_MESSAGE_SECTION, NULL);
+  section->window_size = window_size;
+
+  return section;
+}
+
+/*
+ * im_message_section_new_view:
+ * @source: the section whose items are shown
+ * @private_attributes: the attributes that are left out while the view
+ *   is masked
+ *
+ * Creates a section that shows the items of @source.  It is masked
+ * initially.  A view doesn't store any messages, and the functions that
+ * add or remove them must not be called on it.
+ */
+ImMessageSection *
+im_message_section_new_view (ImMessageSection    *source,
+                             const gchar * const *private_attributes)
+{
+  ImMessageSection *section;
+
+  g_return_val_if_fail (IM_IS_MESSAGE_SECTION (source), NULL);
+  g_return_val_if_fail (source->source == NULL, NULL);
+
+  section = g_object_new (IM_TYPE_MESSAGE_SECTION, NULL);
+  section->source = g_object_ref (source);
+  section->private_attributes = g_strdupv ((gchar **) private_attributes);
+  section->masked = TRUE;
+
+  g_signal_connect (source, "items-changed", G_CALLBACK (im_message_section_source_items_changed), section);
+
+  return section;
+}
+
+/*
+ * im_message_section_set_masked:
+ *
+ * Changes whether @view leaves out the private attributes.  All of its
+ * items are replaced in a single items-changed.
+ */
+void
+im_message_section_set_masked (ImMessageSection *view,
+                               gboolean          masked)
+{
+  gint n_items;
+
+  g_return_if_fail (IM_IS_MESSAGE_SECTION (view));
+  g_return_if_fail (view->source != NULL);
+
+  if (view->masked == masked)
+    return;
+
+  view->masked = masked;
+
+  n_items = im_message_section_get_n_items (G_MENU_MODEL (view));
+  if (n_items > 0)
+    g_menu_model_items_changed (G_MENU_MODEL (view), 0, n_items, n_items);
+}
+
+void
+im_message_section_set_window_size (ImMessageSection *section,
+                                    guint             window_size)
+{
+  guint n_messages;
+  guint n_visible;
+
+  g_return_if_fail (IM_IS_MESSAGE_SECTION (section));
+  g_return_if_fail (section->source == NULL);
+
+  section->window_size = window_size;
+
+  n_messages = g_sequence_get_length (section->messages);
+  n_visible = window_size > 0 ? MIN (window_size, n_messages) : n_messages;
+
+  if (n_visible > section->n_visible)
+    {
+      guint old_n_visible = section->n_visible;
+
+      section->n_visible = n_visible;
+      g_menu_model_items_changed (G_MENU_MODEL (section), old_n_visible, 0, n_visible - old_n_visible);
+    }
+  else if (n_visible < section->n_visible)
+    {
+      guint old_n_visible = section->n_visible;
+
+      section->n_visible = n_visible;
+      g_menu_model_items_changed (G_MENU_MODEL (section), n_visible, old_n_visible - n_visible, 0);
+    }
+
+  im_message_section_update_more_item (section);
+}
+
+guint
+im_message_section_get_window_size (ImMessageSection *section)
+{
+  g_return_val_if_fail (IM_IS_MESSAGE_SECTION (section), 0);
+
+  return section->window_size;
+}
+
+/*
+ * im_message_section_add:
+ * @key: identifies the message; a message that is added with an
+ *   existing key replaces the old one
+ * @attributes: the item's attributes, as returned by
+ *   g_menu_model_get_item_attributes().  It is referenced, not copied.
+ */
+void
+im_message_section_add (ImMessageSection *section,
+                        const gchar      *app_id,
+                        const gchar      *key,
+                        gint64            time,
+                        GHashTable       *attributes)
+{
+  MessageNode *node;
+  GSequenceIter *iter;
+  GHashTable *app_messages;
+  guint pos;
+
+  g_return_if_fail (IM_IS_MESSAGE_SECTION (section));
+  g_return_if_fail (section->source == NULL);
+  g_return_if_fail (app_id != NULL);
+  g_return_if_fail (key != NULL);
+  g_return_if_fail (attributes != NULL);
+
+  iter = g_hash_table_lookup (section->message_index, key);
+  if (iter)
+    im_message_section_remove_iter (section, iter);
+
+  node = g_slice_new (MessageNode);
+  node->app_id = g_strdup (app_id);
+  node->key = g_strdup (key);
+  node->time = time;
+  node->attributes = g_hash_table_ref (attributes);
+
+  iter = g_sequence_insert_sorted (section->messages, node, message_node_compare, NULL);
+  g_hash_table_insert (section->message_index, node->key, iter);
+
+  app_messages = g_hash_table_lookup (section->app_messages, app_id);
+  if (app_messages == NULL)
+    {
+      app_messages = g_hash_table_new (NULL, NULL);
+      g_hash_table_insert (section->app_messages, g_strdup (app_id), app_messages);
+    }
+  g_hash_table_add (app_messages, iter);
+
+  pos = g_sequence_iter_get_position (iter);
+  if (section->window_size == 0 || pos < section->window_size)
+    {
+      section->n_visible++;
+      g_menu_model_items_changed (G_MENU_MODEL (section), pos, 0, 1);
+
+      /* push the oldest visible message out of the window */
+      if (section->window_size > 0 && section->n_visible > section->window_size)
+        {
+          section->n_visible--;
+          g_menu_model_items_changed (G_MENU_MODEL (section), section->n_visible, 1, 0);
+        }
+    }
+
+  im_message_section_update_more_item (section);
+}
+
+void
+im_message_section_remove (ImMessageSection *section,
+                           const gchar      *key)
+{
+  GSequenceIter *iter;
+
+  g_return_if_fail (IM_IS_MESSAGE_SECTION (section));
+  g_return_if_fail (section->source == NULL);
+  g_return_if_fail (key != NULL);
+
+  iter = g_hash_table_lookup (section->message_index, key);
+  if (iter)
+    im_message_section_remove_iter (section, iter);
+}
+
+void
+im_message_section_remove_application (ImMessageSection *section,
+                                       const gchar      *app_id)
+{
+  GHashTable *app_messages;
+
+  g_return_if_fail (IM_IS_MESSAGE_SECTION (section));
+  g_return_if_fail (section->source == NULL);
+  g_return_if_fail (app_id != NULL);
+
+  /* the set is freed together with its last message */
+  while ((app_messages = g_hash_table_lookup (section->app_messages, app_id)))
+    {
+      GHashTableIter it;
+      gpointer iter;
+
+      g_hash_table_iter_init (&it, app_messages);
+      g_hash_table_iter_next (&it, &iter, NULL);
+      im_message_section_remove_iter (section, iter);
+    }
+}
+
+void
+im_message_section_remove_all (ImMessageSection *section)
+{
+  gint n_items;
+
+  g_return_if_fail (IM_IS_MESSAGE_SECTION (section));
+  g_return_if_fail (section->source == NULL);
+
+  n_items = im_message_section_get_n_items (G_MENU_MODEL (section));
+
+  g_hash_table_remove_all (section->message_index);
+  g_hash_table_remove_all (section->app_messages);
+  g_sequence_remove_range (g_sequence_get_begin_iter (section->messages),
+                           g_sequence_get_end_iter (section->messages));
+  section->n_visible = 0;
+  section->show_more = FALSE;
+
+  if (n_items > 0)
+    g_menu_model_items_changed (G_MENU_MODEL (section), 0, n_items, 0);
+}
+
+guint
+im_message_section_get_n_messages (ImMessageSection *section)
+{
+  g_return_val_if_fail (IM_IS_MESSAGE_SECTION (section), 0);
+
+  return g_sequence_get_length (section->messages);
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2026 Ayatana Indicators
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __IM_MESSAGE_SECTION_H__
+#define __IM_MESSAGE_SECTION_H__
+
+#include <gio/gio.h>
+
+#define IM_TYPE_MESSAGE_SECTION            (im_message_section_get_type ())
+#define IM_MESSAGE_SECTION(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), IM_TYPE_MESSAGE_SECTION, ImMessageSection))
+#define IM_IS_MESSAGE_SECTION(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), IM_TYPE_MESSAGE_SECTION))
+
+typedef struct _ImMessageSection ImMessageSection;
+
+GType                   im_message_section_get_type             (void);
+
+ImMessageSection *      im_message_section_new                  (guint             window_size);
+
+ImMessageSection *      im_message_section_new_view             (ImMessageSection    *source,
+                                                                 const gchar * const *private_attributes);
+
+void                    im_message_section_set_masked           (ImMessageSection *view,
+                                                                 gboolean          masked);
+
+void                    im_message_section_set_window_size      (ImMessageSection *section,
+                                                                 guint             window_size);
+
+guint                   im_message_section_get_window_size      (ImMessageSection *section);
+
+void                    im_message_section_add                  (ImMessageSection *section,
+                                                                 const gchar      *app_id,
+                                                                 const gchar      *key,
+                                                                 gint64            time,
+                                                                 GHashTable       *attributes);
+
+void                    im_message_section_remove               (ImMessageSection *section,
+                                                                 const gchar      *key);
+
+void                    im_message_section_remove_application   (ImMessageSection *section,
+                                                                 const gchar      *app_id);
+
+void                    im_message_section_remove_all           (ImMessageSection *section);
+
+guint                   im_message_section_get_n_messages       (ImMessageSection *section);
+
+#endif
@@ -18,6 +18,8 @@
  */
 
 #include "im-phone-menu.h"
+#include "im-message-section.h"
+#include "im-accounts-service.h"
 
 #include <string.h>
 #include <glib/gi18n.h>
@@ -28,34 +30,100 @@ struct _ImPhoneMenu
 {
   ImMenu parent;
 
-  GMenu *message_section;
+  ImMessageSection *message_section;
   GMenu *source_section;
   GMenu *clear_section;
+
+  GSettings *settings;
+  guint page_size;
+
+  /* the menu this one is a view of, or NULL */
+  ImPhoneMenu *phone;
+  ImAccountsService *as;
+
+  /* scratch space for building action names */
+  GString *action_name;
+};
+
+enum
+{
+  PROP_0,
+  PROP_PHONE_MENU,
+  NUM_PROPERTIES
+};
+
+/* message attributes that are only shown on the greeter if the user
+ * allowed it */
+static const gchar * const private_attributes[] = {
+  "x-ayatana-subtitle",
+  "x-ayatana-text",
+  "x-ayatana-message-actions",
+  NULL
 };
 
 G_DEFINE_TYPE (ImPhoneMenu, im_phone_menu, IM_TYPE_MENU);
 
-typedef void (*ImMenuForeachFunc) (GMenuModel *menu, gint pos);
+/* Returns "<app_id>.<kind>.<id>", in a buffer that is reused by the
+ * next call. */
+static const gchar *
+im_phone_menu_build_action_name (ImPhoneMenu *menu,
+                                 const gchar *app_id,
+                                 const gchar *kind,
+                                 const gchar *id)
+{
+  g_string_assign (menu->action_name, app_id);
+  g_string_append_c (menu->action_name, '.');
+  g_string_append (menu->action_name, kind);
+  g_string_append_c (menu->action_name, '.');
+  g_string_append (menu->action_name, id);
+
+  return menu->action_name->str;
+}
+
+/* Returns the action of the item at @position without copying it.  The
+ * string is valid as long as @value, which must be unreffed. */
+static const gchar *
+im_phone_menu_peek_item_action (GMenuModel  *menu,
+                                gint         position,
+                                GVariant   **value)
+{
+  *value = g_menu_model_get_item_attribute_value (menu, position, G_MENU_ATTRIBUTE_ACTION, G_VARIANT_TYPE_STRING);
+
+  return *value ? g_variant_get_string (*value, NULL) : "";
+}
 
+/* Removes all items of @menu whose action matches @action, or starts
+ * with it if @prefix is TRUE. */
 static void
-im_phone_menu_foreach_item_with_action (GMenuModel        *menu,
-                                        const gchar       *action,
-                                        ImMenuForeachFunc  func)
+im_phone_menu_remove_items_with_action (GMenu       *menu,
+                                        const gchar *action,
+                                        gboolean     prefix)
 {
   gint n_items;
-  gint i;
+  gint i = 0;
 
-  n_items = g_menu_model_get_n_items (menu);
-  for (i = 0; i < n_items; i++)
+  n_items = g_menu_model_get_n_items (G_MENU_MODEL (menu));
+  while (i < n_items)
     {
-      gchar *item_action;
+      GVariant *value;
+      const gchar *item_action;
+      gboolean matches;
 
-      g_menu_model_get_item_attribute (menu, i, G_MENU_ATTRIBUTE_ACTION, "s", &item_action);
+      item_action = im_phone_menu_peek_item_action (G_MENU_MODEL (menu), i, &value);
+      matches = prefix ? g_str_has_prefix (item_action, action) : g_str_equal (item_action, action);
 
-      if (g_str_equal (action, item_action))
-        func (menu, i);
+      if (value)
+        g_variant_unref (value);
 
-      g_free (item_action);
+      if (matches)
+        {
+          g_menu_remove (menu, i);
+          n_items--;
+        }
+      else
+        {
+          i++;
+        }
     }
 }
 
@@ -66,7 +134,7 @@ im_phone_menu_update_clear_section (ImPhoneMenu *menu)
   gboolean should_be_shown;
 
   is_shown = g_menu_model_get_n_items (G_MENU_MODEL (menu->clear_section)) > 0;
-  should_be_shown = (g_menu_model_get_n_items (G_MENU_MODEL (menu->message_section)) +
+  should_be_shown = (im_message_section_get_n_messages (menu->message_section) +
                      g_menu_model_get_n_items (G_MENU_MODEL (menu->source_section))) > 0;
 
   if (!is_shown && should_be_shown)
@@ -85,22 +153,161 @@ im_phone_menu_update_clear_section (ImPhoneMenu *menu)
     }
 }
 
+/* The window shows the newest messages of all applications, so each
+ * application needs to list as many as fit in it, and one more to tell
+ * whether "Show More" is needed */
 static void
-im_phone_menu_constructed (GObject *object)
+im_phone_menu_update_messages_wanted (ImPhoneMenu *menu)
 {
-  ImPhoneMenu *menu = IM_PHONE_MENU (object);
+  guint window_size;
+
+  if (!im_menu_is_started (IM_MENU (menu)))
+    return;
+
+  window_size = im_message_section_get_window_size (menu->message_section);
+  im_application_list_set_messages_wanted (im_menu_get_application_list (IM_MENU (menu)),
+                                           window_size > 0 ? window_size + 1 : G_MAXUINT);
+}
+
+static void
+im_phone_menu_page_size_changed (GSettings   *settings,
+                                 const gchar *key,
+                                 gpointer     user_data)
+{
+  ImPhoneMenu *menu = user_data;
+
+  menu->page_size = g_settings_get_uint (settings, "visible-messages");
+  im_message_section_set_window_size (menu->message_section, menu->page_size);
+  im_phone_menu_update_messages_wanted (menu);
+}
+
+static void
+im_phone_menu_show_more_messages (ImPhoneMenu *menu)
+{
+  guint window_size;
+
+  window_size = im_message_section_get_window_size (menu->message_section);
+  if (window_size > 0)
+    {
+      im_message_section_set_window_size (menu->message_section, window_size + menu->page_size);
+      im_phone_menu_update_messages_wanted (menu);
+    }
+}
+
+static void
+im_phone_menu_replay_message (ImApplicationList *applist,
+                              const gchar       *app_id,
+                              GVariant          *serialized_app_icon,
+                              const gchar       *id,
+                              GVariant          *serialized_icon,
+                              const gchar       *title,
+                              const gchar       *subtitle,
+                              const gchar       *body,
+                              GVariant          *actions,
+                              gint64             time,
+                              gboolean           draws_attention,
+                              gpointer           user_data)
+{
+  im_phone_menu_add_message (user_data, app_id, serialized_app_icon, id, serialized_icon,
+                             title, subtitle, body, actions, time);
+}
+
+static void
+im_phone_menu_update_masked (ImPhoneMenu *menu)
+{
+  im_message_section_set_masked (menu->message_section, !im_menu_show_data (IM_MENU (menu)));
+}
+
+/* Follows the application list while a client is subscribed, starting
+ * with the messages that are already there.  A view instead keeps the
+ * menu it shows started, and only asks accountsservice whether it may
+ * show the messages' contents once it is shown. */
+static void
+im_phone_menu_start (ImMenu *menu)
+{
+  ImPhoneMenu *self = IM_PHONE_MENU (menu);
   ImApplicationList *applist;
 
-  im_menu_append_section (IM_MENU (menu), G_MENU_MODEL (menu->message_section));
-  im_menu_append_section (IM_MENU (menu), G_MENU_MODEL (menu->source_section));
-  im_menu_append_section (IM_MENU (menu), G_MENU_MODEL (menu->clear_section));
+  if (self->phone)
+    {
+      g_signal_connect_swapped (self->as, "notify::show-on-greeter",
+                                G_CALLBACK (im_phone_menu_update_masked), self);
+      im_phone_menu_update_masked (self);
+      im_menu_hold (IM_MENU (self->phone));
+      return;
+    }
 
-  applist = im_menu_get_application_list (IM_MENU (menu));
+  applist = im_menu_get_application_list (menu);
 
   g_signal_connect_swapped (applist, "message-added", G_CALLBACK (im_phone_menu_add_message), menu);
   g_signal_connect_swapped (applist, "message-removed", G_CALLBACK (im_phone_menu_remove_message), menu);
   g_signal_connect_swapped (applist, "app-stopped", G_CALLBACK (im_phone_menu_remove_application), menu);
   g_signal_connect_swapped (applist, "remove-all", G_CALLBACK (im_phone_menu_remove_all), menu);
+  g_signal_connect_swapped (applist, "show-more-messages", G_CALLBACK (im_phone_menu_show_more_messages), menu);
+
+  im_application_list_foreach_message (applist, im_phone_menu_replay_message, menu);
+  im_phone_menu_update_messages_wanted (self);
+}
+
+static void
+im_phone_menu_stop (ImMenu *menu)
+{
+  ImPhoneMenu *self = IM_PHONE_MENU (menu);
+  ImApplicationList *applist;
+
+  if (self->phone)
+    {
+      g_signal_handlers_disconnect_by_func (self->as, im_phone_menu_update_masked, self);
+      im_menu_release (IM_MENU (self->phone));
+      return;
+    }
+
+  applist = im_menu_get_application_list (menu);
+
+  g_signal_handlers_disconnect_by_func (applist, im_phone_menu_add_message, menu);
+  g_signal_handlers_disconnect_by_func (applist, im_phone_menu_remove_message, menu);
+  g_signal_handlers_disconnect_by_func (applist, im_phone_menu_remove_application, menu);
+  g_signal_handlers_disconnect_by_func (applist, im_phone_menu_remove_all, menu);
+  g_signal_handlers_disconnect_by_func (applist, im_phone_menu_show_more_messages, menu);
+
+  im_phone_menu_remove_all (IM_PHONE_MENU (menu));
+  im_application_list_set_messages_wanted (applist, 0);
+}
+
+static void
+im_phone_menu_constructed (GObject *object)
+{
+  ImPhoneMenu *menu = IM_PHONE_MENU (object);
+
+  if (menu->phone)
+    {
+      /* the view only hides what the greeter must not show; messages and
+       * sources are those of the phone menu.  It stays masked until it
+       * is started. */
+      menu->message_section = im_message_section_new_view (menu->phone->message_section, private_attributes);
+      menu->source_section = g_object_ref (menu->phone->source_section);
+      menu->clear_section = g_object_ref (menu->phone->clear_section);
+
+      menu->as = im_accounts_service_ref_default ();
+    }
+  else
+    {
+      menu->message_section = im_message_section_new (0);
+      menu->source_section = g_menu_new ();
+      menu->clear_section = g_menu_new ();
+    }
+
+  im_menu_append_section (IM_MENU (menu), G_MENU_MODEL (menu->message_section));
+  im_menu_append_section (IM_MENU (menu), G_MENU_MODEL (menu->source_section));
+  im_menu_append_section (IM_MENU (menu), G_MENU_MODEL (menu->clear_section));
+
+  if (menu->phone == NULL)
+    {
+      menu->settings = g_settings_new ("org.ayatana.indicator.messages");
+      g_signal_connect (menu->settings, "changed::visible-messages",
+                        G_CALLBACK (im_phone_menu_page_size_changed), menu);
+      im_phone_menu_page_size_changed (menu->settings, "visible-messages", menu);
+    }
 
   G_OBJECT_CLASS (im_phone_menu_parent_class)->constructed (object);
 }
@@ -110,6 +317,13 @@ im_phone_menu_dispose (GObject *object)
 {
   ImPhoneMenu *menu = IM_PHONE_MENU (object);
 
+  if (menu->settings)
+    g_signal_handlers_disconnect_by_func (menu->settings, im_phone_menu_page_size_changed, menu);
+  g_clear_object (&menu->settings);
+  if (menu->as)
+    g_signal_handlers_disconnect_by_func (menu->as, im_phone_menu_update_masked, menu);
+  g_clear_object (&menu->as);
+  g_clear_object (&menu->phone);
   g_clear_object (&menu->message_section);
   g_clear_object (&menu->source_section);
   g_clear_object (&menu->clear_section);
@@ -120,9 +334,51 @@ im_phone_menu_dispose (GObject *object)
 static void
 im_phone_menu_finalize (GObject *object)
 {
+  ImPhoneMenu *menu = IM_PHONE_MENU (object);
+
+  g_string_free (menu->action_name, TRUE);
+
   G_OBJECT_CLASS (im_phone_menu_parent_class)->finalize (object);
 }
 
+static void
+im_phone_menu_get_property (GObject    *object,
+                            guint       property_id,
+                            GValue     *value,
+                            GParamSpec *pspec)
+{
+  ImPhoneMenu *menu = IM_PHONE_MENU (object);
+
+  switch (property_id)
+    {
+    case PROP_PHONE_MENU:
+      g_value_set_object (value, menu->phone);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    }
+}
+
+static void
+im_phone_menu_set_property (GObject      *object,
+                            guint         property_id,
+                            const GValue *value,
+                            GParamSpec   *pspec)
+{
+  ImPhoneMenu *menu = IM_PHONE_MENU (object);
+
+  switch (property_id)
+    {
+    case PROP_PHONE_MENU: /* construct only */
+      menu->phone = g_value_dup_object (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    }
+}
+
 static void
 im_phone_menu_class_init (ImPhoneMenuClass *klass)
 {
@@ -131,14 +387,24 @@ im_phone_menu_class_init (ImPhoneMenuClass *klass)
   object_class->constructed = im_phone_menu_constructed;
   object_class->dispose = im_phone_menu_dispose;
   object_class->finalize = im_phone_menu_finalize;
+  object_class->get_property = im_phone_menu_get_property;
+  object_class->set_property = im_phone_menu_set_property;
+
+  klass->start = im_phone_menu_start;
+  klass->stop = im_phone_menu_stop;
+
+  g_object_class_install_property (object_class, PROP_PHONE_MENU,
+                                   g_param_spec_object ("phone-menu", "", "",
+                                                        IM_TYPE_PHONE_MENU,
+                                                        G_PARAM_CONSTRUCT_ONLY |
+                                                        G_PARAM_READWRITE |
+                                                        G_PARAM_STATIC_STRINGS));
 }
 
 static void
 im_phone_menu_init (ImPhoneMenu *menu)
 {
-  menu->message_section = g_menu_new ();
-  menu->source_section = g_menu_new ();
-  menu->clear_section = g_menu_new ();
+  menu->action_name = g_string_new (NULL);
 }
 
 ImPhoneMenu *
@@ -152,21 +418,39 @@ im_phone_menu_new (ImApplicationList  *applist, gboolean greeter)
                        NULL);
 }
 
-static gint64
-im_phone_menu_get_message_time (GMenuModel *model,
-                                gint        i)
+/*
+ * im_phone_menu_new_view:
+ *
+ * Creates the greeter's menu, which shows the messages and sources of
+ * @phone without keeping copies of them.  The subtitle, body and actions
+ * of messages are hidden unless the user allowed showing them on the
+ * greeter.
+ */
+ImPhoneMenu *
+im_phone_menu_new_view (ImPhoneMenu *phone)
 {
-  gint64 time;
+  g_return_val_if_fail (IM_IS_PHONE_MENU (phone), NULL);
+  g_return_val_if_fail (phone->phone == NULL, NULL);
 
-  g_menu_model_get_item_attribute (model, i, "x-ayatana-time", "x", &time);
+  return g_object_new (IM_TYPE_PHONE_MENU,
+                       "application-list", im_menu_get_application_list (IM_MENU (phone)),
+                       "on-greeter", TRUE,
+                       "phone-menu", phone,
+                       NULL);
+}
 
-  return time;
+static void
+im_phone_menu_set_attribute (GHashTable  *attributes,
+                             const gchar *name,
+                             GVariant    *value)
+{
+  g_hash_table_insert (attributes, (gpointer) name, g_variant_ref_sink (value));
 }
 
 void
 im_phone_menu_add_message (ImPhoneMenu     *menu,
                            const gchar     *app_id,
-                           GIcon           *app_icon,
+                           GVariant        *serialized_app_icon,
                            const gchar     *id,
                            GVariant        *serialized_icon,
                            const gchar     *title,
@@ -175,54 +459,47 @@ im_phone_menu_add_message (ImPhoneMenu     *menu,
                            GVariant        *actions,
                            gint64           time)
 {
-  GMenuItem *item;
-  gchar *action_name;
-  gint n_messages;
-  gint pos;
-  GVariant *serialized_app_icon;
+  GHashTable *attributes;
+  const gchar *action_name;
   gboolean show_data;
 
   g_return_if_fail (IM_IS_PHONE_MENU (menu));
   g_return_if_fail (app_id);
 
   show_data = im_menu_show_data(IM_MENU (menu));
-  action_name = g_strconcat (app_id, ".msg.", id, NULL);
+  action_name = im_phone_menu_build_action_name (menu, app_id, "msg", id);
 
-  item = g_menu_item_new (title, NULL);
-  g_menu_item_set_action_and_target_value (item, action_name, g_variant_new_boolean (TRUE));
+  /* the section only exports the newest messages, so the item's
+   * attributes are stored directly instead of in a GMenuItem */
+  attributes = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) g_variant_unref);
+
+  if (title)
+    im_phone_menu_set_attribute (attributes, G_MENU_ATTRIBUTE_LABEL, g_variant_new_string (title));
+  im_phone_menu_set_attribute (attributes, G_MENU_ATTRIBUTE_ACTION, g_variant_new_string (action_name));
+  im_phone_menu_set_attribute (attributes, G_MENU_ATTRIBUTE_TARGET, g_variant_new_boolean (TRUE));
 
-  g_menu_item_set_attribute (item, "x-ayatana-type", "s", "org.ayatana.indicator.messages.messageitem");
-  g_menu_item_set_attribute (item, "x-ayatana-message-id", "s", id);
+  im_phone_menu_set_attribute (attributes, "x-ayatana-type", g_variant_new_string ("org.ayatana.indicator.messages.messageitem"));
+  im_phone_menu_set_attribute (attributes, "x-ayatana-message-id", g_variant_new_string (id));
   if (show_data)
-    g_menu_item_set_attribute (item, "x-ayatana-subtitle", "s", subtitle);
+    im_phone_menu_set_attribute (attributes, "x-ayatana-subtitle", g_variant_new_string (subtitle));
   if (show_data)
-    g_menu_item_set_attribute (item, "x-ayatana-text", "s", body);
-  g_menu_item_set_attribute (item, "x-ayatana-time", "x", time);
+    im_phone_menu_set_attribute (attributes, "x-ayatana-text", g_variant_new_string (body));
+  im_phone_menu_set_attribute (attributes, "x-ayatana-time", g_variant_new_int64 (time));
 
   if (serialized_icon)
-    g_menu_item_set_attribute_value (item, "icon", serialized_icon);
+    im_phone_menu_set_attribute (attributes, "icon", serialized_icon);
 
-  if (app_icon && (serialized_app_icon = g_icon_serialize (app_icon)))
-    {
-      g_menu_item_set_attribute_value (item, "x-ayatana-app-icon", serialized_app_icon);
-      g_variant_unref (serialized_app_icon);
-    }
+  if (serialized_app_icon)
+    im_phone_menu_set_attribute (attributes, "x-ayatana-app-icon", serialized_app_icon);
 
   if (actions && show_data)
-    g_menu_item_set_attribute (item, "x-ayatana-message-actions", "v", actions);
-
-  n_messages = g_menu_model_get_n_items (G_MENU_MODEL (menu->message_section));
-  pos = 0;
-  while (pos < n_messages &&
-         time < im_phone_menu_get_message_time (G_MENU_MODEL (menu->message_section), pos))
-    pos++;
+    im_phone_menu_set_attribute (attributes, "x-ayatana-message-actions", g_variant_new_variant (actions));
 
-  g_menu_insert_item (menu->message_section, pos, item);
+  im_message_section_add (menu->message_section, app_id, action_name, time, attributes);
 
   im_phone_menu_update_clear_section (menu);
 
-  g_free (action_name);
-  g_object_unref (item);
+  g_hash_table_unref (attributes);
 }
 
 void
@@ -230,19 +507,13 @@ im_phone_menu_remove_message (ImPhoneMenu     *menu,
                               const gchar     *app_id,
                               const gchar     *id)
 {
-  gchar *action_name;
-
   g_return_if_fail (IM_IS_PHONE_MENU (menu));
   g_return_if_fail (app_id != NULL);
 
-  action_name = g_strconcat (app_id, ".msg.", id, NULL);
-  im_phone_menu_foreach_item_with_action (G_MENU_MODEL (menu->message_section),
-                                          action_name,
-                                          (ImMenuForeachFunc) g_menu_remove);
+  im_message_section_remove (menu->message_section,
+                             im_phone_menu_build_action_name (menu, app_id, "msg", id));
 
   im_phone_menu_update_clear_section (menu);
-
-  g_free (action_name);
 }
 
 void
@@ -253,12 +524,12 @@ im_phone_menu_add_source (ImPhoneMenu     *menu,
                           const gchar     *iconstr)
 {
   GMenuItem *item;
-  gchar *action_name;
+  const gchar *action_name;
 
   g_return_if_fail (IM_IS_PHONE_MENU (menu));
   g_return_if_fail (app_id != NULL);
 
-  action_name = g_strconcat (app_id, ".src.", id, NULL);
+  action_name = im_phone_menu_build_action_name (menu, app_id, "src", id);
 
   item = g_menu_item_new (label, NULL);
   g_menu_item_set_action_and_target_value (item, action_name, g_variant_new_boolean (TRUE));
@@ -269,7 +540,6 @@ im_phone_menu_add_source (ImPhoneMenu     *menu,
 
   g_menu_prepend_item (menu->source_section, item);
 
-  g_free (action_name);
   g_object_unref (item);
 }
 
@@ -278,49 +548,12 @@ im_phone_menu_remove_source (ImPhoneMenu     *menu,
                              const gchar     *app_id,
                              const gchar     *id)
 {
-  gchar *action_name;
-
   g_return_if_fail (IM_IS_PHONE_MENU (menu));
   g_return_if_fail (app_id != NULL);
 
-  action_name = g_strconcat (app_id, ".src.", id, NULL);
-  im_phone_menu_foreach_item_with_action (G_MENU_MODEL (menu->source_section),
-                                          action_name,
-                                          (ImMenuForeachFunc) g_menu_remove);
-
-  g_free (action_name);
-}
-
-static void
-im_phone_menu_remove_all_for_app (GMenu           *menu,
-                                  const gchar     *app_id)
-{
-  gchar *prefix;
-  gint n_items;
-  gint i = 0;
-
-  prefix = g_strconcat (app_id, ".", NULL);
-
-  n_items = g_menu_model_get_n_items (G_MENU_MODEL (menu));
-  while (i < n_items)
-    {
-      gchar *action;
-
-      g_menu_model_get_item_attribute (G_MENU_MODEL (menu), i, G_MENU_ATTRIBUTE_ACTION, "s", &action);
-      if (g_str_has_prefix (action, prefix))
-        {
-          g_menu_remove (menu, i);
-          n_items--;
-        }
-      else
-        {
-          i++;
-        }
-
-      g_free (action);
-    }
-
-  g_free (prefix);
+  im_phone_menu_remove_items_with_action (menu->source_section,
+                                          im_phone_menu_build_action_name (menu, app_id, "src", id),
+                                          FALSE);
 }
 
 void
@@ -330,8 +563,12 @@ im_phone_menu_remove_application (ImPhoneMenu     *menu,
   g_return_if_fail (IM_IS_PHONE_MENU (menu));
   g_return_if_fail (app_id != NULL);
 
-  im_phone_menu_remove_all_for_app (menu->source_section, app_id);
-  im_phone_menu_remove_all_for_app (menu->message_section, app_id);
+  g_string_assign (menu->action_name, app_id);
+  g_string_append_c (menu->action_name, '.');
+
+  im_phone_menu_remove_items_with_action (menu->source_section, menu->action_name->str, TRUE);
+
+  im_message_section_remove_application (menu->message_section, app_id);
 
   im_phone_menu_update_clear_section (menu);
 }
@@ -341,11 +578,11 @@ im_phone_menu_remove_all (ImPhoneMenu *menu)
 {
   g_return_if_fail (IM_IS_PHONE_MENU (menu));
 
-  while (g_menu_model_get_n_items (G_MENU_MODEL (menu->message_section)))
-    g_menu_remove (menu->message_section, 0);
+  /* start over with a single page */
+  im_message_section_remove_all (menu->message_section);
+  im_message_section_set_window_size (menu->message_section, menu->page_size);
 
-  while (g_menu_model_get_n_items (G_MENU_MODEL (menu->source_section)))
-    g_menu_remove (menu->source_section, 0);
+  g_menu_remove_all (menu->source_section);
 
   im_phone_menu_update_clear_section (menu);
 }
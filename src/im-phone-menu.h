@@ -36,9 +36,11 @@ GType               im_phone_menu_get_type              (void);
 ImPhoneMenu *       im_phone_menu_new                   (ImApplicationList  *applist,
                                                          gboolean           greeter);
 
+ImPhoneMenu *       im_phone_menu_new_view              (ImPhoneMenu        *phone);
+
 void                im_phone_menu_add_message           (ImPhoneMenu        *menu,
                                                          const gchar        *app_id,
-                                                         GIcon              *app_icon,
+                                                         GVariant           *serialized_app_icon,
                                                          const gchar        *id,
                                                          GVariant           *serialized_icon,
                                                          const gchar        *title,
@@ -0,0 +1,256 @@
+/*
+ * Copyright 2026 Ayatana Indicators
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "im-source-section.h"
+
+/*
+ * ImSourceSection is the section of an application's sources in the
+ * desktop menu.  Sources are shown in the order they were added and are
+ * indexed by id.  A source whose label or icon changed is updated in
+ * place, with a single items-changed (pos, 1, 1), so that clients can
+ * keep their widget; removing all sources is a single items-changed as
+ * well.
+ */
+
+typedef GMenuModelClass ImSourceSectionClass;
+
+struct _ImSourceSection
+{
+  GMenuModel parent;
+
+  GSequence *sources;       /* SourceNode, in the order they were added */
+  GHashTable *source_index; /* id -> GSequenceIter */
+};
+
+typedef struct
+{
+  gchar *id;
+  GHashTable *attributes;
+} SourceNode;
+
+G_DEFINE_TYPE (ImSourceSection, im_source_section, G_TYPE_MENU_MODEL);
+
+static void
+source_node_free (gpointer data)
+{
+  SourceNode *node = data;
+
+  g_free (node->id);
+  g_hash_table_unref (node->attributes);
+
+  g_slice_free (SourceNode, node);
+}
+
+static GHashTable *
+source_attributes_new (const gchar *source_id,
+                       const gchar *label,
+                       GVariant    *serialized_icon)
+{
+  GHashTable *attributes;
+  gchar *action;
+
+  attributes = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) g_variant_unref);
+
+  action = g_strconcat ("src.", source_id, NULL);
+  g_hash_table_insert (attributes, G_MENU_ATTRIBUTE_ACTION, g_variant_ref_sink (g_variant_new_take_string (action)));
+  g_hash_table_insert (attributes, "x-ayatana-type",
+                       g_variant_ref_sink (g_variant_new_string ("org.ayatana.indicator.messages.source")));
+
+  if (label)
+    g_hash_table_insert (attributes, G_MENU_ATTRIBUTE_LABEL, g_variant_ref_sink (g_variant_new_string (label)));
+
+  if (serialized_icon)
+    g_hash_table_insert (attributes, "icon", g_variant_ref_sink (serialized_icon));
+
+  return attributes;
+}
+
+/* The item's action carries count, time and string; only label and
+ * icon are part of the item itself */
+static gboolean
+source_node_matches (SourceNode  *node,
+                     const gchar *label,
+                     GVariant    *serialized_icon)
+{
+  GVariant *item_label;
+  GVariant *item_icon;
+
+  item_label = g_hash_table_lookup (node->attributes, G_MENU_ATTRIBUTE_LABEL);
+  item_icon = g_hash_table_lookup (node->attributes, "icon");
+
+  if (g_strcmp0 (item_label ? g_variant_get_string (item_label, NULL) : NULL, label) != 0)
+    return FALSE;
+
+  if (item_icon && serialized_icon)
+    return g_variant_equal (item_icon, serialized_icon);
+  else
+    return item_icon == NULL && serialized_icon == NULL;
+}
+
+static gboolean
+im_source_section_is_mutable (GMenuModel *model)
+{
+  return TRUE;
+}
+
+static gint
+im_source_section_get_n_items (GMenuModel *model)
+{
+  ImSourceSection *section = IM_SOURCE_SECTION (model);
+
+  return g_sequence_get_length (section->sources);
+}
+
+static void
+im_source_section_get_item_attributes (GMenuModel  *model,
+                                       gint         position,
+                                       GHashTable **table)
+{
+  ImSourceSection *section = IM_SOURCE_SECTION (model);
+  SourceNode *node;
+
+  node = g_sequence_get (g_sequence_get_iter_at_pos (section->sources, position));
+  *table = g_hash_table_ref (node->attributes);
+}
+
+static void
+im_source_section_get_item_links (GMenuModel  *model,
+                                  gint         position,
+                                  GHashTable **table)
+{
+  *table = g_hash_table_new (NULL, NULL);
+}
+
+static void
+im_source_section_finalize (GObject *object)
+{
+  ImSourceSection *section = IM_SOURCE_SECTION (object);
+
+  g_hash_table_unref (section->source_index);
+  g_sequence_free (section->sources);
+
+  G_OBJECT_CLASS (im_source_section_parent_class)->finalize (object);
+}
+
+static void
+im_source_section_class_init (ImSourceSectionClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  GMenuModelClass *model_class = G_MENU_MODEL_CLASS (klass);
+
+  object_class->finalize = im_source_section_finalize;
+
+  model_class->is_mutable = im_source_section_is_mutable;
+  model_class->get_n_items = im_source_section_get_n_items;
+  model_class->get_item_attributes = im_source_section_get_item_attributes;
+  model_class->get_item_links = im_source_section_get_item_links;
+}
+
+static void
+im_source_section_init (ImSourceSection *section)
+{
+  section->sources = g_sequence_new (source_node_free);
+  section->source_index = g_hash_table_new (g_str_hash, g_str_equal);
+}
+
+ImSourceSection *
+im_source_section_new (void)
+{
+  return g_object_new (IM_TYPE_SOURCE_SECTION, NULL);
+}
+
+/*
+ * im_source_section_set_source:
+ *
+ * Appends the source @source_id, or updates its item in place if it is
+ * already in @section.
+ */
+void
+im_source_section_set_source (ImSourceSection *section,
+                              const gchar     *source_id,
+                              const gchar     *label,
+                              GVariant        *serialized_icon)
+{
+  GSequenceIter *iter;
+  SourceNode *node;
+
+  g_return_if_fail (IM_IS_SOURCE_SECTION (section));
+  g_return_if_fail (source_id != NULL);
+
+  iter = g_hash_table_lookup (section->source_index, source_id);
+  if (iter)
+    {
+      node = g_sequence_get (iter);
+      if (source_node_matches (node, label, serialized_icon))
+        return;
+
+      g_hash_table_unref (node->attributes);
+      node->attributes = source_attributes_new (source_id, label, serialized_icon);
+
+      g_menu_model_items_changed (G_MENU_MODEL (section), g_sequence_iter_get_position (iter), 1, 1);
+    }
+  else
+    {
+      node = g_slice_new (SourceNode);
+      node->id = g_strdup (source_id);
+      node->attributes = source_attributes_new (source_id, label, serialized_icon);
+
+      iter = g_sequence_append (section->sources, node);
+      g_hash_table_insert (section->source_index, node->id, iter);
+
+      g_menu_model_items_changed (G_MENU_MODEL (section), g_sequence_iter_get_position (iter), 0, 1);
+    }
+}
+
+void
+im_source_section_remove_source (ImSourceSection *section,
+                                 const gchar     *source_id)
+{
+  GSequenceIter *iter;
+  gint pos;
+
+  g_return_if_fail (IM_IS_SOURCE_SECTION (section));
+  g_return_if_fail (source_id != NULL);
+
+  iter = g_hash_table_lookup (section->source_index, source_id);
+  if (iter == NULL)
+    return;
+
+  pos = g_sequence_iter_get_position (iter);
+
+  g_hash_table_remove (section->source_index, source_id);
+  g_sequence_remove (iter);
+
+  g_menu_model_items_changed (G_MENU_MODEL (section), pos, 1, 0);
+}
+
+void
+im_source_section_remove_all (ImSourceSection *section)
+{
+  gint n_items;
+
+  g_return_if_fail (IM_IS_SOURCE_SECTION (section));
+
+  n_items = g_sequence_get_length (section->sources);
+  if (n_items == 0)
+    return;
+
+  g_hash_table_remove_all (section->source_index);
+  g_sequence_remove_range (g_sequence_get_begin_iter (section->sources),
+                           g_sequence_get_end_iter (section->sources));
+
+  g_menu_model_items_changed (G_MENU_MODEL (section), 0, n_items, 0);
+}
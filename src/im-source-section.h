@@ -0,0 +1,42 @@
+/*
+ * Copyright 2026 Ayatana Indicators
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __IM_SOURCE_SECTION_H__
+#define __IM_SOURCE_SECTION_H__
+
+#include <gio/gio.h>
+
+#define IM_TYPE_SOURCE_SECTION            (im_source_section_get_type ())
+#define IM_SOURCE_SECTION(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), IM_TYPE_SOURCE_SECTION, ImSourceSection))
+#define IM_IS_SOURCE_SECTION(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), IM_TYPE_SOURCE_SECTION))
+
+typedef struct _ImSourceSection ImSourceSection;
+
+GType                   im_source_section_get_type              (void);
+
+ImSourceSection *       im_source_section_new                   (void);
+
+void                    im_source_section_set_source            (ImSourceSection *section,
+                                                                 const gchar     *source_id,
+                                                                 const gchar     *label,
+                                                                 GVariant        *serialized_icon);
+
+void                    im_source_section_remove_source         (ImSourceSection *section,
+                                                                 const gchar     *source_id);
+
+void                    im_source_section_remove_all            (ImSourceSection *section);
+
+#endif
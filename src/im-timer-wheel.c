@@ -0,0 +1,406 @@
+/*
+ * Copyright 2026 Ayatana Indicators
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "im-timer-wheel.h"
+
+/*
+ * ImTimerWheel expires entries at their deadline (in monotonic time),
+ * with a resolution of one second.
+ *
+ * Entries are kept in a hierarchical timing wheel: LEVELS wheels of
+ * SLOTS slots each, where a slot on level n spans SLOTS^n ticks.  An
+ * entry is put on the lowest level whose span reaches its deadline.
+ * When the lower level wraps around into a slot of a higher level, the
+ * entries of that slot are moved down ("cascaded").  Adding and removing
+ * entries is O(1), regardless of how many there are.
+ *
+ * The wheel is driven by a single GSource whose ready time is set to the
+ * next tick at which anything happens, so an idle wheel, or one whose
+ * entries are far in the future, doesn't wake up the process.
+ */
+
+#define TICK        G_USEC_PER_SEC
+#define SLOT_BITS   6
+#define SLOTS       (1 << SLOT_BITS)
+#define SLOT_MASK   (SLOTS - 1)
+#define LEVELS      4
+
+/* entries that are being expired are on this pseudo level */
+#define EXPIRING    -1
+
+struct _ImTimerWheelEntry
+{
+  ImTimerWheelEntry *prev;
+  ImTimerWheelEntry *next;
+  guint64 tick;
+  gint level;
+  gint slot;
+  gpointer data;
+};
+
+typedef struct
+{
+  GSource source;
+  ImTimerWheel *wheel;
+} WheelSource;
+
+struct _ImTimerWheel
+{
+  ImTimerWheelFunc expire;
+  gpointer user_data;
+
+  guint64 tick;  /* the last tick that was processed */
+  ImTimerWheelEntry *slots[LEVELS][SLOTS];
+  guint64 occupied[LEVELS];  /* bitmaps of the non-empty slots */
+  ImTimerWheelEntry *expiring;
+  guint n_entries;
+
+  GSource *source;
+};
+
+static ImTimerWheelEntry **
+im_timer_wheel_get_list (ImTimerWheel      *wheel,
+                         ImTimerWheelEntry *entry)
+{
+  if (entry->level == EXPIRING)
+    return &wheel->expiring;
+
+  return &wheel->slots[entry->level][entry->slot];
+}
+
+static void
+im_timer_wheel_link (ImTimerWheel      *wheel,
+                     ImTimerWheelEntry *entry)
+{
+  ImTimerWheelEntry **list = im_timer_wheel_get_list (wheel, entry);
+
+  entry->prev = NULL;
+  entry->next = *list;
+  if (*list)
+    (*list)->prev = entry;
+  *list = entry;
+
+  if (entry->level != EXPIRING)
+    wheel->occupied[entry->level] |= G_GUINT64_CONSTANT (1) << entry->slot;
+}
+
+static void
+im_timer_wheel_unlink (ImTimerWheel      *wheel,
+                       ImTimerWheelEntry *entry)
+{
+  ImTimerWheelEntry **list = im_timer_wheel_get_list (wheel, entry);
+
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else
+    *list = entry->next;
+
+  if (entry->next)
+    entry->next->prev = entry->prev;
+
+  if (*list == NULL && entry->level != EXPIRING)
+    wheel->occupied[entry->level] &= ~(G_GUINT64_CONSTANT (1) << entry->slot);
+}
+
+/* Puts @entry on the lowest level that reaches its tick, as seen from
+ * @base, which is the first tick that is not processed yet */
+static void
+im_timer_wheel_place (ImTimerWheel      *wheel,
+                      ImTimerWheelEntry *entry,
+                      guint64            base)
+{
+  guint64 tick = MAX (entry->tick, base);
+  gint level;
+
+  for (level = 0; level < LEVELS - 1; level++)
+    {
+      if ((tick >> (SLOT_BITS * (level + 1))) == (base >> (SLOT_BITS * (level + 1))))
+        break;
+    }
+
+  /* too far in the future: wait for the last slot of the top level,
+   * and again when it comes around */
+  if (level == LEVELS - 1)
+    {
+      guint64 last_block = (base >> (SLOT_BITS * level)) + SLOTS - 1;
+      tick = MIN (tick, last_block << (SLOT_BITS * level));
+    }
+
+  entry->level = level;
+  entry->slot = (tick >> (SLOT_BITS * level)) & SLOT_MASK;
+  im_timer_wheel_link (wheel, entry);
+}
+
+/* Returns the next tick after wheel->tick at which a slot of any level
+ * needs to be processed, or 0 if the wheel is empty */
+static guint64
+im_timer_wheel_next_tick (ImTimerWheel *wheel)
+{
+  guint64 next = 0;
+  gint level;
+
+  for (level = 0; level < LEVELS; level++)
+    {
+      guint64 block;
+      gint i;
+
+      if (wheel->occupied[level] == 0)
+        continue;
+
+      block = wheel->tick >> (SLOT_BITS * level);
+      for (i = 1; i <= SLOTS; i++)
+        {
+          if (wheel->occupied[level] & (G_GUINT64_CONSTANT (1) << ((block + i) & SLOT_MASK)))
+            {
+              guint64 tick = (block + i) << (SLOT_BITS * level);
+
+              if (next == 0 || tick < next)
+                next = tick;
+              break;
+            }
+        }
+    }
+
+  return next;
+}
+
+static void
+im_timer_wheel_schedule (ImTimerWheel *wheel)
+{
+  guint64 next;
+
+  next = im_timer_wheel_next_tick (wheel);
+  g_source_set_ready_time (wheel->source, next ? (gint64) (next * TICK) : -1);
+}
+
+/* Processes @tick: cascades the slots of higher levels that start at
+ * @tick and expires everything in the level 0 slot of @tick */
+static void
+im_timer_wheel_process (ImTimerWheel *wheel,
+                        guint64       tick)
+{
+  gint level;
+  ImTimerWheelEntry *entry;
+
+  wheel->tick = tick;
+
+  for (level = LEVELS - 1; level > 0; level--)
+    {
+      gint slot;
+
+      if (tick & ((G_GUINT64_CONSTANT (1) << (SLOT_BITS * level)) - 1))
+        continue;
+
+      slot = (tick >> (SLOT_BITS * level)) & SLOT_MASK;
+      while ((entry = wheel->slots[level][slot]))
+        {
+          im_timer_wheel_unlink (wheel, entry);
+          im_timer_wheel_place (wheel, entry, tick);
+        }
+    }
+
+  /* move the due entries aside first, as the callback may add and
+   * remove entries, including those that are due at the same time */
+  while ((entry = wheel->slots[0][tick & SLOT_MASK]))
+    {
+      im_timer_wheel_unlink (wheel, entry);
+      entry->level = EXPIRING;
+      im_timer_wheel_link (wheel, entry);
+    }
+
+  while ((entry = wheel->expiring))
+    {
+      gpointer data = entry->data;
+
+      im_timer_wheel_unlink (wheel, entry);
+      g_slice_free (ImTimerWheelEntry, entry);
+      wheel->n_entries--;
+
+      wheel->expire (data, wheel->user_data);
+    }
+}
+
+static gboolean
+im_timer_wheel_dispatch (GSource     *source,
+                         GSourceFunc  callback,
+                         gpointer     user_data)
+{
+  ImTimerWheel *wheel = ((WheelSource *) source)->wheel;
+
+  im_timer_wheel_advance (wheel, g_source_get_time (source));
+
+  return G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs im_timer_wheel_source_funcs = {
+  NULL,
+  NULL,
+  im_timer_wheel_dispatch,
+  NULL
+};
+
+/*
+ * im_timer_wheel_new:
+ * @expire: called for every entry whose deadline has passed
+ * @user_data: passed to @expire
+ *
+ * Creates a timer wheel, attached to the thread-default main context.
+ */
+ImTimerWheel *
+im_timer_wheel_new (ImTimerWheelFunc expire,
+                    gpointer         user_data)
+{
+  ImTimerWheel *wheel;
+
+  g_return_val_if_fail (expire != NULL, NULL);
+
+  wheel = g_slice_new0 (ImTimerWheel);
+  wheel->expire = expire;
+  wheel->user_data = user_data;
+  wheel->tick = g_get_monotonic_time () / TICK;
+
+  wheel->source = g_source_new (&im_timer_wheel_source_funcs, sizeof (WheelSource));
+  ((WheelSource *) wheel->source)->wheel = wheel;
+  g_source_set_name (wheel->source, "ImTimerWheel");
+  g_source_attach (wheel->source, g_main_context_get_thread_default ());
+
+  return wheel;
+}
+
+void
+im_timer_wheel_free (ImTimerWheel *wheel)
+{
+  gint level;
+  gint slot;
+
+  g_return_if_fail (wheel != NULL);
+
+  g_source_destroy (wheel->source);
+  g_source_unref (wheel->source);
+
+  for (level = 0; level < LEVELS; level++)
+    for (slot = 0; slot < SLOTS; slot++)
+      {
+        ImTimerWheelEntry *entry;
+
+        while ((entry = wheel->slots[level][slot]))
+          {
+            wheel->slots[level][slot] = entry->next;
+            g_slice_free (ImTimerWheelEntry, entry);
+          }
+      }
+
+  g_slice_free (ImTimerWheel, wheel);
+}
+
+/*
+ * im_timer_wheel_add:
+ * @wheel: an #ImTimerWheel
+ * @deadline: the monotonic time (as g_get_monotonic_time()) at which
+ *   @data expires; rounded up to the next second
+ * @data: passed to the expire function
+ *
+ * Returns: (transfer none): the new entry, which is valid until it is
+ * removed or expires
+ */
+ImTimerWheelEntry *
+im_timer_wheel_add (ImTimerWheel *wheel,
+                    gint64        deadline,
+                    gpointer      data)
+{
+  ImTimerWheelEntry *entry;
+
+  g_return_val_if_fail (wheel != NULL, NULL);
+
+  /* nothing to cascade in an empty wheel, so it can jump to the
+   * present right away */
+  if (wheel->n_entries == 0)
+    wheel->tick = MAX (wheel->tick, (guint64) g_get_monotonic_time () / TICK);
+
+  entry = g_slice_new (ImTimerWheelEntry);
+  entry->tick = deadline > 0 ? (deadline + TICK - 1) / TICK : 0;
+  entry->data = data;
+
+  im_timer_wheel_place (wheel, entry, wheel->tick + 1);
+  wheel->n_entries++;
+
+  im_timer_wheel_schedule (wheel);
+
+  return entry;
+}
+
+void
+im_timer_wheel_remove (ImTimerWheel      *wheel,
+                       ImTimerWheelEntry *entry)
+{
+  g_return_if_fail (wheel != NULL);
+  g_return_if_fail (entry != NULL);
+
+  im_timer_wheel_unlink (wheel, entry);
+  g_slice_free (ImTimerWheelEntry, entry);
+  wheel->n_entries--;
+
+  /* removing never makes the wheel wake up earlier; a spurious wakeup
+   * is cheaper than looking for the next tick every time */
+  if (wheel->n_entries == 0)
+    g_source_set_ready_time (wheel->source, -1);
+}
+
+/*
+ * im_timer_wheel_advance:
+ * @wheel: an #ImTimerWheel
+ * @now: the current monotonic time
+ *
+ * Expires all entries whose deadline is at or before @now.  Called from
+ * the wheel's own source; only needs to be called directly in tests.
+ */
+void
+im_timer_wheel_advance (ImTimerWheel *wheel,
+                        gint64        now)
+{
+  guint64 now_tick;
+  guint64 next;
+
+  g_return_if_fail (wheel != NULL);
+
+  now_tick = now / TICK;
+
+  /* skip the ticks at which nothing happens */
+  while ((next = im_timer_wheel_next_tick (wheel)) && next <= now_tick)
+    im_timer_wheel_process (wheel, next);
+
+  wheel->tick = MAX (wheel->tick, now_tick);
+
+  im_timer_wheel_schedule (wheel);
+}
+
+/*
+ * im_timer_wheel_get_next_deadline:
+ *
+ * Returns: the monotonic time at which the wheel needs to be advanced
+ * next, or -1 if it is empty
+ */
+gint64
+im_timer_wheel_get_next_deadline (ImTimerWheel *wheel)
+{
+  guint64 next;
+
+  g_return_val_if_fail (wheel != NULL, -1);
+
+  next = im_timer_wheel_next_tick (wheel);
+
+  return next ? (gint64) (next * TICK) : -1;
+}
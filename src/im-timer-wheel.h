@@ -0,0 +1,47 @@
+/*
+ * Copyright 2026 Ayatana Indicators
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 3, as published
+ * by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranties of
+ * MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+ * PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __IM_TIMER_WHEEL_H__
+#define __IM_TIMER_WHEEL_H__
+
+#include <glib.h>
+
+typedef struct _ImTimerWheel ImTimerWheel;
+typedef struct _ImTimerWheelEntry ImTimerWheelEntry;
+
+/* Called with the data of an expired entry.  The entry is freed
+ * already and must not be passed to im_timer_wheel_remove(). */
+typedef void (*ImTimerWheelFunc) (gpointer data,
+                                  gpointer user_data);
+
+ImTimerWheel *          im_timer_wheel_new                      (ImTimerWheelFunc   expire,
+                                                                 gpointer           user_data);
+
+void                    im_timer_wheel_free                     (ImTimerWheel      *wheel);
+
+ImTimerWheelEntry *     im_timer_wheel_add                      (ImTimerWheel      *wheel,
+                                                                 gint64             deadline,
+                                                                 gpointer           data);
+
+void                    im_timer_wheel_remove                   (ImTimerWheel      *wheel,
+                                                                 ImTimerWheelEntry *entry);
+
+void                    im_timer_wheel_advance                  (ImTimerWheel      *wheel,
+                                                                 gint64             now);
+
+gint64                  im_timer_wheel_get_next_deadline        (ImTimerWheel      *wheel);
+
+#endif
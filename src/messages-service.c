@@ -35,15 +35,30 @@ with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "im-phone-menu.h"
 #include "im-desktop-menu.h"
 #include "im-application-list.h"
+#include "im-app-info-cache.h"
 
 #define NUM_STATUSES 5
 
 static ImApplicationList *applications;
+static ImAppInfoCache *app_infos;
 
 static IndicatorMessagesService *messages_service;
 static GHashTable *menus;
 static GSettings *settings;
 
+/* The menu profiles that are exported, and how they differ.  Profiles
+ * with the same configuration are backed by the same menu. */
+static const struct {
+    const gchar *name;
+    gboolean phone;
+    gboolean greeter;
+} profiles[] = {
+    { "phone",           TRUE,  FALSE },
+    { "phone_greeter",   TRUE,  TRUE  },
+    { "desktop",         FALSE, FALSE },
+    { "desktop_greeter", FALSE, FALSE }
+};
+
 enum {
     DBUS_ERROR_BAD_DESKTOP_FILE,
 };
@@ -76,6 +91,36 @@ register_application (IndicatorMessagesService *service,
     return TRUE;
 }
 
+static gboolean
+register_application_with_state (IndicatorMessagesService *service,
+              GDBusMethodInvocation *invocation,
+              const gchar *desktop_id,
+              const gchar *menu_path,
+              GVariant *sources,
+              GVariant *messages,
+              const gchar *messages_cursor,
+              gboolean messages_attention_after,
+              gpointer user_data)
+{
+    GDBusConnection *bus;
+    const gchar *sender;
+
+    if (!im_application_list_add (applications, desktop_id)) {
+        g_dbus_method_invocation_return_error(invocation, dbus_error_quark(), DBUS_ERROR_BAD_DESKTOP_FILE, "Unable to find or parse desktop file for application '%s'", desktop_id);
+        return TRUE;
+    }
+
+    bus = g_dbus_interface_skeleton_get_connection (G_DBUS_INTERFACE_SKELETON (service));
+    sender = g_dbus_method_invocation_get_sender (invocation);
+
+    im_application_list_set_remote_with_state (applications, desktop_id, bus, sender, menu_path, sources, messages, messages_cursor, messages_attention_after);
+    g_settings_strv_append_unique (settings, "applications", desktop_id);
+
+    indicator_messages_service_complete_register_application_with_state (service, invocation);
+
+    return TRUE;
+}
+
 static gboolean
 unregister_application (IndicatorMessagesService *service,
             GDBusMethodInvocation *invocation,
@@ -107,7 +152,7 @@ set_status (IndicatorMessagesService *service,
                   g_str_equal (status_str, "offline"),
                   FALSE);
 
-    appinfo = g_desktop_app_info_new (desktop_id);
+    appinfo = im_app_info_cache_lookup (app_infos, desktop_id);
     if (!appinfo) {
         g_warning ("could not set status for '%s', there's no desktop file with that id", desktop_id);
         return TRUE;
@@ -133,7 +178,7 @@ app_stopped (IndicatorMessagesService *service,
     GDesktopAppInfo *appinfo;
     const gchar *id;
 
-    appinfo = g_desktop_app_info_new (desktop_id);
+    appinfo = im_app_info_cache_lookup (app_infos, desktop_id);
     if (!appinfo)
         return TRUE;
 
@@ -167,6 +212,10 @@ on_bus_acquired (GDBusConnection *bus,
     /* Register some errors */
     g_dbus_error_register_error (dbus_error_quark(), DBUS_ERROR_BAD_DESKTOP_FILE, "BadDesktopFile");
 
+    /* Applications send their state along with the registration and
+     * signal changes right after.  Listen before anyone can register. */
+    im_application_list_watch_connection (applications, bus);
+
     g_dbus_connection_export_action_group (bus, INDICATOR_MESSAGES_DBUS_OBJECT,
                            im_application_list_get_action_group (applications),
                            &error);
@@ -209,6 +258,33 @@ on_name_lost (GDBusConnection *bus,
     g_main_loop_quit (mainloop);
 }
 
+/* Returns a new reference to the menu for profiles[@i], sharing the
+ * menu of an earlier profile with the same configuration */
+static ImMenu *
+menu_for_profile (guint i)
+{
+    guint j;
+
+    for (j = 0; j < i; j++) {
+        if (profiles[j].phone == profiles[i].phone && profiles[j].greeter == profiles[i].greeter)
+            return g_object_ref (g_hash_table_lookup (menus, profiles[j].name));
+    }
+
+    /* the phone's greeter menu is a view of the phone menu, which comes
+     * first in the table */
+    if (profiles[i].phone && profiles[i].greeter) {
+        for (j = 0; j < i; j++) {
+            if (profiles[j].phone && !profiles[j].greeter)
+                return IM_MENU (im_phone_menu_new_view (g_hash_table_lookup (menus, profiles[j].name)));
+        }
+    }
+
+    if (profiles[i].phone)
+        return IM_MENU (im_phone_menu_new (applications, profiles[i].greeter));
+    else
+        return IM_MENU (im_desktop_menu_new (applications));
+}
+
 static gboolean
 sig_term_handler (gpointer user_data)
 {
@@ -250,6 +326,8 @@ main (int argc, char ** argv)
 
     g_signal_connect (messages_service, "handle-register-application",
               G_CALLBACK (register_application), NULL);
+    g_signal_connect (messages_service, "handle-register-application-with-state",
+              G_CALLBACK (register_application_with_state), NULL);
     g_signal_connect (messages_service, "handle-unregister-application",
               G_CALLBACK (unregister_application), NULL);
     g_signal_connect (messages_service, "handle-set-status",
@@ -257,6 +335,7 @@ main (int argc, char ** argv)
     g_signal_connect (messages_service, "handle-application-stopped-running",
               G_CALLBACK (app_stopped), NULL);
 
+    app_infos = im_app_info_cache_ref_default ();
     applications = im_application_list_new ();
     g_signal_connect (applications, "status-set",
               G_CALLBACK (status_set_by_user), NULL);
@@ -274,10 +353,12 @@ main (int argc, char ** argv)
     }
 
     menus = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_object_unref);
-    g_hash_table_insert (menus, "phone", im_phone_menu_new (applications, FALSE));
-    g_hash_table_insert (menus, "phone_greeter", im_phone_menu_new (applications, TRUE));
-    g_hash_table_insert (menus, "desktop", im_desktop_menu_new (applications));
-    g_hash_table_insert (menus, "desktop_greeter", im_desktop_menu_new (applications));
+    {
+        guint i;
+
+        for (i = 0; i < G_N_ELEMENTS (profiles); i++)
+            g_hash_table_insert (menus, (gpointer) profiles[i].name, menu_for_profile (i));
+    }
 
     g_unix_signal_add(SIGTERM, sig_term_handler, mainloop);
 
@@ -288,5 +369,6 @@ main (int argc, char ** argv)
     g_object_unref (messages_service);
     g_object_unref (settings);
     g_object_unref (applications);
+    g_object_unref (app_infos);
     return 0;
 }
@@ -58,7 +58,7 @@ class AccountsServiceMock
             dbus_test_dbus_mock_object_add_property(mock, userobj,
                 "UserName", G_VARIANT_TYPE_STRING,
                 g_variant_new_string(g_get_user_name()), NULL);
-            dbus_test_dbus_mock_object_add_method(mock, baseobj,
+            dbus_test_dbus_mock_object_add_method(mock, userobj,
                 "SetXHasMessages", G_VARIANT_TYPE_BOOLEAN, nullptr,
                 "", NULL);
 
@@ -116,6 +116,13 @@ class AccountsServiceMock
                 NULL);
         }
 
+        guint countXHasMessagesCalls () {
+            guint len = 0;
+            dbus_test_dbus_mock_object_get_method_calls(mock, userobj,
+                "SetXHasMessages", &len, NULL);
+            return len;
+        }
+
         operator std::shared_ptr<DbusTestTask> () {
             return std::shared_ptr<DbusTestTask>(
                 DBUS_TEST_TASK(g_object_ref(mock)),
@@ -595,6 +595,14 @@ class IndicatorFixture : public ::testing::Test
 		_EVENTUALLY_HELPER(STRNE);
 
 		#undef _EVENTUALLY_HELPER
+
+		/* Like expectEventuallyEQ, but gets the actual value again on every try */
+		template <typename T, typename F> testing::AssertionResult expectEventuallyFuncEQ (const char * expectedStr, const char * actualStr, const T& expected, F actual) {
+			std::function<testing::AssertionResult(void)> func = [&]() {
+				return testing::internal::CmpHelperEQ(expectedStr, actualStr, expected, actual());
+			};
+			return expectEventually(func);
+		}
 };
 
 /* Menu Attrib */
@@ -672,6 +680,9 @@ class IndicatorFixture : public ::testing::Test
 #define EXPECT_EVENTUALLY_EQ(expected, actual) \
 	EXPECT_PRED_FORMAT2(IndicatorFixture::expectEventuallyEQ, expected, actual)
 
+#define EXPECT_EVENTUALLY_FUNC_EQ(expected, actual) \
+	EXPECT_PRED_FORMAT2(IndicatorFixture::expectEventuallyFuncEQ, expected, actual)
+
 #define EXPECT_EVENTUALLY_NE(expected, actual) \
 	EXPECT_PRED_FORMAT2(IndicatorFixture::expectEventuallyNE, expected, actual)
 
@@ -151,6 +151,11 @@ TEST_F(IndicatorTest, IconNotification) {
     auto normalicon = std::shared_ptr<GVariant>(g_variant_ref_sink(g_variant_new_parsed("{'icon': <('themed', <['indicator-messages-offline', 'indicator-messages', 'indicator', 'indicator-messages-offline-symbolic', 'indicator-messages-symbolic', 'indicator-symbolic']>)>, 'title': <'Notifications'>, 'tooltip': <'Quick access to newly received messages'>, 'accessible-desc': <'Messages'>, 'visible': <true>}")), [](GVariant *var) {if (var != nullptr) g_variant_unref(var); });
     auto blueicon = std::shared_ptr<GVariant>(g_variant_ref_sink(g_variant_new_parsed("{'icon': <('themed', <['indicator-messages-new-offline', 'indicator-messages-new', 'indicator-messages', 'indicator', 'indicator-messages-new-offline-symbolic', 'indicator-messages-new-symbolic', 'indicator-messages-symbolic', 'indicator-symbolic']>)>, 'title': <'Notifications'>, 'tooltip': <'Quick access to newly received messages'>, 'accessible-desc': <'New Messages'>, 'visible': <true>}")), [](GVariant *var) {if (var != nullptr) g_variant_unref(var); });
 
+    /* Only transitions of the icon reach accountsservice, so the calls
+       alternate between TRUE and FALSE; each is waited for, so that the
+       debounce doesn't merge them */
+    std::function<guint(void)> xHasMessagesCalls = [this]() { return as->countXHasMessagesCalls(); };
+
     setActions("/org/ayatana/indicator/messages");
 
     auto app = std::shared_ptr<MessagingMenuApp>(messaging_menu_app_new("test.desktop"), [](MessagingMenuApp * app) { g_clear_object(&app); });
@@ -175,6 +180,7 @@ TEST_F(IndicatorTest, IconNotification) {
     messaging_menu_app_draw_attention(app2.get(), "countsource");
 
     EXPECT_EVENTUALLY_ACTION_STATE("messages", blueicon);
+    EXPECT_EVENTUALLY_FUNC_EQ(1u, xHasMessagesCalls);
 
     auto msg = std::shared_ptr<MessagingMenuMessage>(messaging_menu_message_new(
         "messageid",
@@ -199,13 +205,77 @@ TEST_F(IndicatorTest, IconNotification) {
 
     EXPECT_EVENTUALLY_ACTION_STATE("messages", normalicon);
     EXPECT_ACTION_ENABLED("remove-all", false);
+    EXPECT_EVENTUALLY_FUNC_EQ(2u, xHasMessagesCalls);
 
     messaging_menu_app_append_message(app.get(), msg.get(), nullptr, FALSE);
 
     EXPECT_EVENTUALLY_ACTION_STATE("messages", blueicon);
     EXPECT_ACTION_ENABLED("remove-all", true);
+    EXPECT_EVENTUALLY_FUNC_EQ(3u, xHasMessagesCalls);
 
     activateAction("remove-all");
 
     EXPECT_EVENTUALLY_ACTION_STATE("messages", normalicon);
+    EXPECT_EVENTUALLY_FUNC_EQ(4u, xHasMessagesCalls);
+}
+
+TEST_F(IndicatorTest, AttentionBeyondMessageLimit) {
+    setActions("/org/ayatana/indicator/messages");
+
+    /* more messages than max-messages-per-application allows (200 by
+       default), of which only the oldest draws attention */
+    auto app = std::shared_ptr<MessagingMenuApp>(messaging_menu_app_new("test.desktop"), [](MessagingMenuApp * app) { g_clear_object(&app); });
+    ASSERT_NE(nullptr, app);
+
+    for (int i = 1; i <= 250; i++) {
+        gchar *id = g_strdup_printf("message%d", i);
+        auto msg = messaging_menu_message_new(id, nullptr, "Message", "", "", i);
+        messaging_menu_message_set_draws_attention(msg, i == 1);
+        messaging_menu_app_append_message(app.get(), msg, nullptr, FALSE);
+        g_object_unref(msg);
+        g_free(id);
+    }
+
+    messaging_menu_app_register(app.get());
+
+    EXPECT_EVENTUALLY_ACTION_EXISTS("test.msg.message250");
+
+    /* it is listed although it comes after the limit, and kept */
+    EXPECT_EVENTUALLY_ACTION_EXISTS("test.msg.message1");
+    EXPECT_ACTION_DOES_NOT_EXIST("test.msg.message2");
+}
+
+TEST_F(IndicatorTest, MessagesOnDemand) {
+    setActions("/org/ayatana/indicator/messages");
+
+    auto app = std::shared_ptr<MessagingMenuApp>(messaging_menu_app_new("test.desktop"), [](MessagingMenuApp * app) { g_clear_object(&app); });
+    ASSERT_NE(nullptr, app);
+
+    for (int i = 1; i <= 100; i++) {
+        gchar *id = g_strdup_printf("message%d", i);
+        auto msg = messaging_menu_message_new(id, nullptr, "Message", "", "", i);
+        messaging_menu_app_append_message(app.get(), msg, nullptr, FALSE);
+        g_object_unref(msg);
+        g_free(id);
+    }
+
+    messaging_menu_app_register(app.get());
+
+    /* only the newest messages come along with the registration */
+    EXPECT_EVENTUALLY_ACTION_EXISTS("test.msg.message100");
+    EXPECT_EVENTUALLY_ACTION_EXISTS("test.msg.message51");
+    EXPECT_ACTION_DOES_NOT_EXIST("test.msg.message50");
+
+    /* they fill the phone menu's first window */
+    setMenu("/org/ayatana/indicator/messages/phone");
+
+    EXPECT_EVENTUALLY_MENU_ATTRIB(std::vector<int>({0, 0, 0}), "x-ayatana-message-id", "message100");
+    EXPECT_ACTION_DOES_NOT_EXIST("test.msg.message50");
+
+    /* the next page is listed once the window grows past them */
+    activateAction("show-more-messages");
+    activateAction("show-more-messages");
+
+    EXPECT_EVENTUALLY_ACTION_EXISTS("test.msg.message50");
+    EXPECT_EVENTUALLY_ACTION_EXISTS("test.msg.message1");
 }
@@ -0,0 +1,215 @@
+/*
+An indicator to show information that is in messaging applications
+that the user is using.
+
+Copyright 2026 Ayatana Indicators
+
+This program is free software: you can redistribute it and/or modify it 
+under the terms of the GNU General Public License version 3, as published 
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but 
+WITHOUT ANY WARRANTY; without even the implied warranties of 
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR 
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along 
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "im-action-table.h"
+}
+
+typedef struct {
+	gint n_added;
+	gint n_removed;
+	gint n_state_changed;
+	gchar *activated;
+} TestClosure;
+
+static void
+action_added (GActionGroup *group, const gchar *name, gpointer user_data)
+{
+	((TestClosure *) user_data)->n_added++;
+}
+
+static void
+action_removed (GActionGroup *group, const gchar *name, gpointer user_data)
+{
+	((TestClosure *) user_data)->n_removed++;
+}
+
+/* the action must still exist while action-removed is emitted */
+static void
+action_removed_query_state (GActionGroup *group, const gchar *name, gpointer user_data)
+{
+	GVariant *state;
+
+	state = g_action_group_get_action_state (group, name);
+	ASSERT_TRUE (state != NULL);
+	g_free (*(gchar **) user_data);
+	*(gchar **) user_data = g_variant_dup_string (state, NULL);
+	g_variant_unref (state);
+}
+
+static void
+action_state_changed (GActionGroup *group, const gchar *name, GVariant *state, gpointer user_data)
+{
+	((TestClosure *) user_data)->n_state_changed++;
+}
+
+static void
+activate (ImActionTable *table, const gchar *name, GVariant *parameter, gpointer user_data)
+{
+	TestClosure *c = (TestClosure *) user_data;
+
+	g_free (c->activated);
+	c->activated = g_strdup (name);
+
+	/* removing the action while it is being activated must be safe */
+	im_action_table_remove (table, name);
+}
+
+TEST(ImActionTableTest, InsertAndRemove) {
+	ImActionTable *table;
+	gchar **actions;
+	gboolean draws_attention;
+
+	table = im_action_table_new (G_VARIANT_TYPE_BOOLEAN, NULL, NULL);
+
+	im_action_table_insert (table, "b", NULL, FALSE);
+	im_action_table_insert (table, "c", NULL, TRUE);
+	im_action_table_insert (table, "a", NULL, FALSE);
+	EXPECT_EQ (3, im_action_table_get_n_actions (table));
+
+	/* actions are kept sorted */
+	actions = g_action_group_list_actions (G_ACTION_GROUP (table));
+	EXPECT_EQ (3, g_strv_length (actions));
+	EXPECT_STREQ ("a", actions[0]);
+	EXPECT_STREQ ("b", actions[1]);
+	EXPECT_STREQ ("c", actions[2]);
+	g_strfreev (actions);
+
+	EXPECT_TRUE (im_action_table_lookup (table, "c", &draws_attention));
+	EXPECT_TRUE (draws_attention);
+	EXPECT_TRUE (im_action_table_lookup (table, "a", &draws_attention));
+	EXPECT_FALSE (draws_attention);
+	EXPECT_FALSE (im_action_table_lookup (table, "d", &draws_attention));
+	EXPECT_FALSE (draws_attention);
+
+	/* inserting an existing name replaces the action */
+	im_action_table_insert (table, "a", NULL, TRUE);
+	EXPECT_EQ (3, im_action_table_get_n_actions (table));
+	EXPECT_TRUE (im_action_table_lookup (table, "a", &draws_attention));
+	EXPECT_TRUE (draws_attention);
+
+	EXPECT_TRUE (im_action_table_remove (table, "b"));
+	EXPECT_FALSE (im_action_table_remove (table, "b"));
+	EXPECT_FALSE (g_action_group_has_action (G_ACTION_GROUP (table), "b"));
+	EXPECT_TRUE (g_action_group_has_action (G_ACTION_GROUP (table), "a"));
+	EXPECT_TRUE (g_action_group_has_action (G_ACTION_GROUP (table), "c"));
+	EXPECT_EQ (2, im_action_table_get_n_actions (table));
+
+	g_object_unref (table);
+}
+
+TEST(ImActionTableTest, State) {
+	ImActionTable *table;
+	GVariant *state;
+
+	table = im_action_table_new (G_VARIANT_TYPE_BOOLEAN, NULL, NULL);
+
+	im_action_table_insert (table, "stateless", NULL, FALSE);
+	im_action_table_insert (table, "stateful", g_variant_new_string ("one"), FALSE);
+
+	EXPECT_TRUE (g_variant_type_equal (G_VARIANT_TYPE_BOOLEAN,
+	             g_action_group_get_action_parameter_type (G_ACTION_GROUP (table), "stateless")));
+	EXPECT_TRUE (g_action_group_get_action_state_type (G_ACTION_GROUP (table), "stateless") == NULL);
+	EXPECT_TRUE (g_action_group_get_action_enabled (G_ACTION_GROUP (table), "stateless"));
+
+	state = g_action_group_get_action_state (G_ACTION_GROUP (table), "stateful");
+	EXPECT_STREQ ("one", g_variant_get_string (state, NULL));
+	g_variant_unref (state);
+
+	EXPECT_TRUE (im_action_table_set_state (table, "stateful", g_variant_new_string ("two"), TRUE));
+	EXPECT_FALSE (im_action_table_set_state (table, "missing", g_variant_new_string ("two"), TRUE));
+
+	state = g_action_group_get_action_state (G_ACTION_GROUP (table), "stateful");
+	EXPECT_STREQ ("two", g_variant_get_string (state, NULL));
+	g_variant_unref (state);
+
+	/* states can't be changed from the outside */
+	g_action_group_change_action_state (G_ACTION_GROUP (table), "stateful", g_variant_new_string ("three"));
+	state = g_action_group_get_action_state (G_ACTION_GROUP (table), "stateful");
+	EXPECT_STREQ ("two", g_variant_get_string (state, NULL));
+	g_variant_unref (state);
+
+	g_object_unref (table);
+}
+
+TEST(ImActionTableTest, Signals) {
+	ImActionTable *table;
+	TestClosure closure = { 0, 0, 0, NULL };
+
+	table = im_action_table_new (G_VARIANT_TYPE_BOOLEAN, activate, &closure);
+
+	g_signal_connect (table, "action-added", G_CALLBACK (action_added), &closure);
+	g_signal_connect (table, "action-removed", G_CALLBACK (action_removed), &closure);
+	g_signal_connect (table, "action-state-changed", G_CALLBACK (action_state_changed), &closure);
+
+	im_action_table_insert (table, "one", g_variant_new_int32 (1), FALSE);
+	EXPECT_EQ (1, closure.n_added);
+
+	/* unchanged states are not announced */
+	im_action_table_set_state (table, "one", g_variant_new_int32 (1), FALSE);
+	EXPECT_EQ (0, closure.n_state_changed);
+	im_action_table_set_state (table, "one", g_variant_new_int32 (2), FALSE);
+	EXPECT_EQ (1, closure.n_state_changed);
+
+	/* replacing is announced as a removal and an addition */
+	im_action_table_insert (table, "one", NULL, FALSE);
+	EXPECT_EQ (1, closure.n_removed);
+	EXPECT_EQ (2, closure.n_added);
+
+	/* parameters of the wrong type are rejected */
+	g_test_expect_message ("Ayatana-Indicator-Messages", G_LOG_LEVEL_WARNING, "*invalid parameter*");
+	g_action_group_activate_action (G_ACTION_GROUP (table), "one", NULL);
+	g_test_assert_expected_messages ();
+	EXPECT_TRUE (closure.activated == NULL);
+
+	g_action_group_activate_action (G_ACTION_GROUP (table), "one", g_variant_new_boolean (TRUE));
+	EXPECT_STREQ ("one", closure.activated);
+	EXPECT_EQ (2, closure.n_removed);
+	EXPECT_EQ (0, im_action_table_get_n_actions (table));
+
+	g_free (closure.activated);
+	g_object_unref (table);
+}
+
+TEST(ImActionTableTest, StateWhileRemoved) {
+	ImActionTable *table;
+	gchar *removed_state = NULL;
+
+	table = im_action_table_new (NULL, NULL, NULL);
+	g_signal_connect (table, "action-removed", G_CALLBACK (action_removed_query_state), &removed_state);
+
+	im_action_table_insert (table, "one", g_variant_new_string ("old"), FALSE);
+
+	/* replacing announces the removal of the old action */
+	im_action_table_insert (table, "one", g_variant_new_string ("new"), FALSE);
+	EXPECT_STREQ ("old", removed_state);
+	EXPECT_EQ (1, im_action_table_get_n_actions (table));
+
+	im_action_table_remove (table, "one");
+	EXPECT_STREQ ("new", removed_state);
+	EXPECT_FALSE (g_action_group_has_action (G_ACTION_GROUP (table), "one"));
+	EXPECT_EQ (0, im_action_table_get_n_actions (table));
+
+	g_free (removed_state);
+	g_object_unref (table);
+}
@@ -0,0 +1,226 @@
+/*
+An indicator to show information that is in messaging applications
+that the user is using.
+
+Copyright 2026 Ayatana Indicators
+
+This program is free software: you can redistribute it and/or modify it
+under the terms of the GNU General Public License version 3, as published
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranties of
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "im-message-section.h"
+}
+
+typedef struct {
+	gint position;
+	gint removed;
+	gint added;
+} ItemsChanged;
+
+static void
+items_changed (GMenuModel *model, gint position, gint removed, gint added, gpointer user_data)
+{
+	ItemsChanged change = { position, removed, added };
+
+	((std::vector<ItemsChanged> *) user_data)->push_back (change);
+}
+
+/* checks the recorded items-changed signals and forgets them */
+static void
+expect_changes (std::vector<ItemsChanged> &changes, std::vector<ItemsChanged> expected)
+{
+	guint i;
+
+	ASSERT_EQ (expected.size (), changes.size ());
+	for (i = 0; i < expected.size (); i++)
+	{
+		EXPECT_EQ (expected[i].position, changes[i].position) << "change " << i;
+		EXPECT_EQ (expected[i].removed, changes[i].removed) << "change " << i;
+		EXPECT_EQ (expected[i].added, changes[i].added) << "change " << i;
+	}
+
+	changes.clear ();
+}
+
+/* the messages' labels are their keys */
+static void
+expect_labels (GMenuModel *model, std::vector<std::string> expected)
+{
+	gint i;
+
+	ASSERT_EQ ((gint) expected.size (), g_menu_model_get_n_items (model));
+	for (i = 0; i < (gint) expected.size (); i++)
+	{
+		gchar *label = NULL;
+
+		EXPECT_TRUE (g_menu_model_get_item_attribute (model, i, G_MENU_ATTRIBUTE_LABEL, "s", &label));
+		EXPECT_STREQ (expected[i].c_str (), label);
+		g_free (label);
+	}
+}
+
+static void
+add_message (ImMessageSection *section, const gchar *key, gint64 time)
+{
+	GHashTable *attributes;
+
+	attributes = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) g_variant_unref);
+	g_hash_table_insert (attributes, (gpointer) G_MENU_ATTRIBUTE_LABEL,
+	                     g_variant_ref_sink (g_variant_new_string (key)));
+	g_hash_table_insert (attributes, (gpointer) "x-ayatana-text",
+	                     g_variant_ref_sink (g_variant_new_string ("secret")));
+
+	im_message_section_add (section, "app", key, time, attributes);
+
+	g_hash_table_unref (attributes);
+}
+
+TEST(ImMessageSectionTest, Add) {
+	ImMessageSection *section;
+	std::vector<ItemsChanged> changes;
+
+	section = im_message_section_new (2);
+	g_signal_connect (section, "items-changed", G_CALLBACK (items_changed), &changes);
+
+	add_message (section, "b", 2);
+	expect_changes (changes, { { 0, 0, 1 } });
+
+	/* newer messages come first */
+	add_message (section, "a", 3);
+	expect_changes (changes, { { 0, 0, 1 } });
+	expect_labels (G_MENU_MODEL (section), { "a", "b" });
+
+	/* a message outside the window only adds "Show More" */
+	add_message (section, "c", 1);
+	expect_changes (changes, { { 2, 0, 1 } });
+	expect_labels (G_MENU_MODEL (section), { "a", "b", "Show More" });
+
+	/* a message inside the window pushes the oldest visible one out */
+	add_message (section, "d", 4);
+	expect_changes (changes, { { 0, 0, 1 }, { 2, 1, 0 } });
+	expect_labels (G_MENU_MODEL (section), { "d", "a", "Show More" });
+
+	EXPECT_EQ (4u, im_message_section_get_n_messages (section));
+
+	g_object_unref (section);
+}
+
+TEST(ImMessageSectionTest, Remove) {
+	ImMessageSection *section;
+	std::vector<ItemsChanged> changes;
+
+	section = im_message_section_new (2);
+	add_message (section, "a", 4);
+	add_message (section, "b", 3);
+	add_message (section, "c", 2);
+	add_message (section, "d", 1);
+	expect_labels (G_MENU_MODEL (section), { "a", "b", "Show More" });
+
+	g_signal_connect (section, "items-changed", G_CALLBACK (items_changed), &changes);
+
+	/* removing a message outside the window doesn't change the items */
+	im_message_section_remove (section, "d");
+	expect_changes (changes, { });
+
+	/* the next message slides in for a visible one */
+	im_message_section_remove (section, "a");
+	expect_changes (changes, { { 0, 1, 0 }, { 1, 0, 1 }, { 2, 1, 0 } });
+	expect_labels (G_MENU_MODEL (section), { "b", "c" });
+
+	im_message_section_remove (section, "c");
+	expect_changes (changes, { { 1, 1, 0 } });
+	expect_labels (G_MENU_MODEL (section), { "b" });
+
+	im_message_section_remove (section, "missing");
+	expect_changes (changes, { });
+
+	EXPECT_EQ (1u, im_message_section_get_n_messages (section));
+
+	g_object_unref (section);
+}
+
+TEST(ImMessageSectionTest, WindowSize) {
+	ImMessageSection *section;
+	std::vector<ItemsChanged> changes;
+
+	section = im_message_section_new (1);
+	add_message (section, "a", 3);
+	add_message (section, "b", 2);
+	add_message (section, "c", 1);
+	expect_labels (G_MENU_MODEL (section), { "a", "Show More" });
+
+	g_signal_connect (section, "items-changed", G_CALLBACK (items_changed), &changes);
+
+	im_message_section_set_window_size (section, 3);
+	expect_changes (changes, { { 1, 0, 2 }, { 3, 1, 0 } });
+	expect_labels (G_MENU_MODEL (section), { "a", "b", "c" });
+
+	im_message_section_set_window_size (section, 2);
+	expect_changes (changes, { { 2, 1, 0 }, { 2, 0, 1 } });
+	expect_labels (G_MENU_MODEL (section), { "a", "b", "Show More" });
+
+	/* 0 shows all messages */
+	im_message_section_set_window_size (section, 0);
+	expect_changes (changes, { { 2, 0, 1 }, { 3, 1, 0 } });
+	expect_labels (G_MENU_MODEL (section), { "a", "b", "c" });
+
+	EXPECT_EQ (0u, im_message_section_get_window_size (section));
+
+	g_object_unref (section);
+}
+
+TEST(ImMessageSectionTest, View) {
+	const gchar *private_attributes[] = { "x-ayatana-text", NULL };
+	ImMessageSection *section;
+	ImMessageSection *view;
+	std::vector<ItemsChanged> changes;
+	gchar *text = NULL;
+
+	section = im_message_section_new (0);
+	view = im_message_section_new_view (section, private_attributes);
+	g_signal_connect (view, "items-changed", G_CALLBACK (items_changed), &changes);
+
+	/* views follow their section and start out masked */
+	add_message (section, "a", 2);
+	add_message (section, "b", 1);
+	expect_changes (changes, { { 0, 0, 1 }, { 1, 0, 1 } });
+	expect_labels (G_MENU_MODEL (view), { "a", "b" });
+	EXPECT_FALSE (g_menu_model_get_item_attribute (G_MENU_MODEL (view), 0, "x-ayatana-text", "s", &text));
+
+	/* toggling the mask replaces all items at once */
+	im_message_section_set_masked (view, FALSE);
+	expect_changes (changes, { { 0, 2, 2 } });
+	EXPECT_TRUE (g_menu_model_get_item_attribute (G_MENU_MODEL (view), 0, "x-ayatana-text", "s", &text));
+	EXPECT_STREQ ("secret", text);
+	g_free (text);
+
+	im_message_section_set_masked (view, FALSE);
+	expect_changes (changes, { });
+
+	im_message_section_set_masked (view, TRUE);
+	expect_changes (changes, { { 0, 2, 2 } });
+	expect_labels (G_MENU_MODEL (view), { "a", "b" });
+
+	im_message_section_remove (section, "a");
+	expect_changes (changes, { { 0, 1, 0 } });
+
+	g_object_unref (view);
+	g_object_unref (section);
+}
@@ -0,0 +1,131 @@
+/*
+An indicator to show information that is in messaging applications
+that the user is using.
+
+Copyright 2026 Ayatana Indicators
+
+This program is free software: you can redistribute it and/or modify it 
+under the terms of the GNU General Public License version 3, as published 
+by the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful, but 
+WITHOUT ANY WARRANTY; without even the implied warranties of 
+MERCHANTABILITY, SATISFACTORY QUALITY, or FITNESS FOR A PARTICULAR 
+PURPOSE.  See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along 
+with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <glib.h>
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "im-timer-wheel.h"
+}
+
+typedef struct {
+	ImTimerWheel *wheel;
+	GPtrArray *expired;
+	ImTimerWheelEntry *remove_on_expiry;
+	gpointer remove_data;
+} TestClosure;
+
+static void
+expire (gpointer data, gpointer user_data)
+{
+	TestClosure *c = (TestClosure *) user_data;
+
+	g_ptr_array_add (c->expired, data);
+
+	if (data == c->remove_data)
+		c->remove_on_expiry = NULL;
+
+	if (c->remove_on_expiry) {
+		im_timer_wheel_remove (c->wheel, c->remove_on_expiry);
+		c->remove_on_expiry = NULL;
+	}
+}
+
+TEST(ImTimerWheelTest, ExpiresInOrder) {
+	TestClosure c = { NULL, g_ptr_array_new (), NULL, NULL };
+	gint64 now = g_get_monotonic_time ();
+
+	c.wheel = im_timer_wheel_new (expire, &c);
+	EXPECT_EQ (-1, im_timer_wheel_get_next_deadline (c.wheel));
+
+	im_timer_wheel_add (c.wheel, now + 30 * G_USEC_PER_SEC, (gpointer) "b");
+	im_timer_wheel_add (c.wheel, now + 10 * G_USEC_PER_SEC, (gpointer) "a");
+	im_timer_wheel_add (c.wheel, now + 90 * G_USEC_PER_SEC, (gpointer) "c");
+
+	im_timer_wheel_advance (c.wheel, now + 5 * G_USEC_PER_SEC);
+	EXPECT_EQ (0, c.expired->len);
+
+	im_timer_wheel_advance (c.wheel, now + 31 * G_USEC_PER_SEC);
+	ASSERT_EQ (2, c.expired->len);
+	EXPECT_STREQ ("a", (const gchar *) g_ptr_array_index (c.expired, 0));
+	EXPECT_STREQ ("b", (const gchar *) g_ptr_array_index (c.expired, 1));
+
+	/* "c" is on a higher level and has to be cascaded first */
+	im_timer_wheel_advance (c.wheel, now + 91 * G_USEC_PER_SEC);
+	ASSERT_EQ (3, c.expired->len);
+	EXPECT_STREQ ("c", (const gchar *) g_ptr_array_index (c.expired, 2));
+	EXPECT_EQ (-1, im_timer_wheel_get_next_deadline (c.wheel));
+
+	im_timer_wheel_free (c.wheel);
+	g_ptr_array_free (c.expired, TRUE);
+}
+
+TEST(ImTimerWheelTest, FarFuture) {
+	TestClosure c = { NULL, g_ptr_array_new (), NULL, NULL };
+	gint64 now = g_get_monotonic_time ();
+	gint64 deadline = now + 3 * 24 * 3600 * G_USEC_PER_SEC;
+
+	c.wheel = im_timer_wheel_new (expire, &c);
+	im_timer_wheel_add (c.wheel, deadline, (gpointer) "far");
+
+	/* the wheel only wakes up for cascading, never after the deadline */
+	while (c.expired->len == 0) {
+		gint64 next = im_timer_wheel_get_next_deadline (c.wheel);
+
+		ASSERT_NE (-1, next);
+		ASSERT_LE (next, deadline + G_USEC_PER_SEC);
+		im_timer_wheel_advance (c.wheel, next);
+	}
+
+	EXPECT_EQ (-1, im_timer_wheel_get_next_deadline (c.wheel));
+	EXPECT_STREQ ("far", (const gchar *) g_ptr_array_index (c.expired, 0));
+
+	im_timer_wheel_free (c.wheel);
+	g_ptr_array_free (c.expired, TRUE);
+}
+
+TEST(ImTimerWheelTest, Remove) {
+	TestClosure c = { NULL, g_ptr_array_new (), NULL, NULL };
+	gint64 now = g_get_monotonic_time ();
+	ImTimerWheelEntry *removed;
+
+	c.wheel = im_timer_wheel_new (expire, &c);
+
+	removed = im_timer_wheel_add (c.wheel, now + 10 * G_USEC_PER_SEC, (gpointer) "removed");
+	im_timer_wheel_add (c.wheel, now + 10 * G_USEC_PER_SEC, (gpointer) "kept");
+	im_timer_wheel_remove (c.wheel, removed);
+
+	im_timer_wheel_advance (c.wheel, now + 11 * G_USEC_PER_SEC);
+	ASSERT_EQ (1, c.expired->len);
+	EXPECT_STREQ ("kept", (const gchar *) g_ptr_array_index (c.expired, 0));
+
+	/* removing an entry that is due at the same time from the callback
+	 * must be safe, and the removed entry must not fire */
+	im_timer_wheel_add (c.wheel, now + 20 * G_USEC_PER_SEC, (gpointer) "one");
+	c.remove_data = (gpointer) "two";
+	c.remove_on_expiry = im_timer_wheel_add (c.wheel, now + 20 * G_USEC_PER_SEC, c.remove_data);
+	im_timer_wheel_add (c.wheel, now + 20 * G_USEC_PER_SEC, (gpointer) "three");
+
+	im_timer_wheel_advance (c.wheel, now + 21 * G_USEC_PER_SEC);
+	EXPECT_EQ (3, c.expired->len);
+	EXPECT_EQ (-1, im_timer_wheel_get_next_deadline (c.wheel));
+
+	im_timer_wheel_free (c.wheel);
+	g_ptr_array_free (c.expired, TRUE);
+}